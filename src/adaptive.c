@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "adaptive.h"
+#include "bigint.h"
+#include "hashtbl.h"
+#include "stats.h"
+#include "simulation.h"
+#include "conversion.h"
+#include "sparsemap.h"
+#include "slowlife.h"
+
+enum { ENGINE_HASHLIFE, ENGINE_SPARSE };
+
+static const char *engine_names[] = {"hashlife", "sparse"};
+
+// The pattern is either in sim or in s
+typedef struct Adapt
+{
+  Hashtbl           *htbl;
+  const Rule_kernel *k;
+  int                engine;
+  Sim               *sim;
+  Smap              *s;
+  double             cost[2]; // seconds per generation, < 0 if unknown
+} Adapt;
+
+int     adapt_small(Hashtbl *htbl, Sim *sim);
+void    adapt_to_sparse(Adapt *a);
+void    adapt_to_hashlife(Adapt *a);
+
+/**************************************************/
+
+Quad *adaptive_destiny(
+  Hashtbl *htbl,
+  Quad *q,
+  const BigInt *t,
+  int e_min,
+  int *e,
+  FILE *log)
+{
+  Adapt a = {
+    .htbl   = htbl,
+    .k      = hashtbl_kernel(htbl),
+    .engine = ENGINE_HASHLIFE,
+    .sim    = sim_new(htbl, q),
+    .s      = NULL,
+    .cost   = {-1, -1},
+  };
+
+  BigInt *left = bi_copy(t);
+  double done = 0;
+  int k = ADAPT_FIRST, sparse_slices = 0;
+
+  // Never goes back
+  sim_set_history(a.sim, 0);
+
+  // The first slice is in the sparse engine, which is cheap on the
+  // small patterns
+  if ( adapt_small(htbl, a.sim) )
+    adapt_to_sparse(&a);
+
+  while ( !bi_iszero(left) )
+  {
+    BigInt *len = bi_power_2(k);
+
+    if ( bi_cmp(left, len) < 0 )
+    {
+      bi_free(len);
+      len = bi_copy(left);
+    }
+
+    const double t0 = stats_now();
+    // Slices of more than 2^30 generations are powers of 2
+    const double gens = bi_log2(len) <= 31 ?
+      (unsigned) bi_to_int(len) : ldexp(1, bi_log2(len) - 1);
+    int next = a.engine;
+
+    if ( a.engine == ENGINE_HASHLIFE )
+    {
+      const Stats *st = hashtbl_stats(htbl);
+      // Inert nodes count as hits
+      const long hits = st->fate_hits + st->fate_inert,
+                 misses = st->fate_misses;
+      const int nodes = hashtbl_count(htbl);
+
+      sim_advance(a.sim, len);
+
+      const double dh = st->fate_hits + st->fate_inert - hits,
+                   dm = st->fate_misses - misses;
+      const double hit = dh + dm > 0 ? dh / (dh + dm) : 1;
+      const double growth = (hashtbl_count(htbl) - nodes) / gens;
+
+      // Twice as many generations take about as long in hashlife
+      a.cost[ENGINE_HASHLIFE] = (stats_now() - t0) / (2 * gens);
+
+      // Hashlife is left when it was slower and the counters do not
+      // show that the pattern is settling
+      const int chaotic = hit < ADAPT_HIT_MIN || growth >= ADAPT_GROWTH_MIN;
+
+      if ( chaotic && a.cost[ENGINE_SPARSE] >= 0 &&
+           a.cost[ENGINE_SPARSE] < a.cost[ENGINE_HASHLIFE] &&
+           k <= ADAPT_SPARSE_MAX &&
+           adapt_small(htbl, a.sim) )
+      {
+        next = ENGINE_SPARSE;
+
+        if ( log )
+          fprintf(log, "adaptive: hit rate %.2f, %.1f new nodes/gen, "
+                       "%.3g s/gen, ", hit, growth, a.cost[ENGINE_HASHLIFE]);
+      }
+    }
+    else
+    {
+      a.s = slowlife(a.k, a.s, bi_to_int(len));
+
+      if ( !a.s )
+      {
+        perror("adaptive_destiny()");
+        exit(1);
+      }
+
+      a.cost[ENGINE_SPARSE] = (stats_now() - t0) / gens;
+
+      // Hashlife is measured after the first slice, then again from time
+      // to time
+      if ( a.cost[ENGINE_SPARSE] >= a.cost[ENGINE_HASHLIFE] ||
+           ++sparse_slices == ADAPT_REPROBE )
+      {
+        next = ENGINE_HASHLIFE;
+
+        if ( log )
+          fprintf(log, "adaptive: %.3g s/gen, ", a.cost[ENGINE_SPARSE]);
+      }
+    }
+
+    BigInt *l = bi_sub(left, len);
+
+    bi_free(left);
+    bi_free(len);
+    left = l;
+    done += gens;
+
+    if ( next != a.engine )
+    {
+      if ( next == ENGINE_SPARSE )
+        adapt_to_sparse(&a);
+      else
+        adapt_to_hashlife(&a);
+
+      sparse_slices = 0;
+
+      if ( log )
+        fprintf(log, "%s from generation %.0f\n", engine_names[next], done);
+    }
+    else if ( a.engine == ENGINE_HASHLIFE || k < ADAPT_SPARSE_MAX )
+      k++;
+  }
+
+  if ( a.engine == ENGINE_SPARSE )
+  {
+    q = smap_to_quad(htbl, a.s, e_min, e);
+    freesmp(a.s);
+  }
+  else
+  {
+    q = sim_whole(a.sim, e_min, e);
+    sim_free(a.sim);
+  }
+
+  bi_free(left);
+
+  return q;
+}
+
+/*** Auxiliary functions ***/
+
+// The live cells of the root are in its top-left square of side
+// 2^ADAPT_SPARSE_DEPTH, so that their coordinates hold in an int
+int adapt_small(Hashtbl *htbl, Sim *sim)
+{
+  Quad *q = sim_current(sim)->root;
+
+  for ( ; q->depth >= ADAPT_SPARSE_DEPTH ; q = q->node.n.sub[0] )
+  {
+    Quad *ds = dead_space(htbl, q->depth - 1);
+
+    if ( q->node.n.sub[1] != ds || q->node.n.sub[2] != ds ||
+         q->node.n.sub[3] != ds )
+      return 0;
+  }
+
+  return 1;
+}
+
+void adapt_to_sparse(Adapt *a)
+{
+  const int x = -bi_to_int(sim_current(a->sim)->offset);
+
+  a->s = quad_to_smap(a->htbl, sim_current(a->sim)->root, x, x);
+  a->engine = ENGINE_SPARSE;
+
+  sim_free(a->sim);
+  a->sim = NULL;
+}
+
+void adapt_to_hashlife(Adapt *a)
+{
+  int e;
+
+  Quad *q = smap_to_quad(a->htbl, a->s, 0, &e);
+  BigInt *o = bi_power_2(e);
+
+  a->sim = sim_new_at(a->htbl, q, o);
+  sim_set_history(a->sim, 0);
+  a->engine = ENGINE_HASHLIFE;
+
+  bi_free(o);
+  freesmp(a->s);
+  a->s = NULL;
+}
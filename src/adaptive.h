@@ -0,0 +1,39 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdio.h>
+#include "bigint.h"
+#include "hashtbl.h"
+
+/* Adaptive evolution: the pattern goes forward by slices of generations,
+ * each one in hashlife or in the sparse engine (see slowlife.h).
+ *
+ * The first slice is in the sparse engine, the second one in hashlife,
+ * then the engine of each slice is the one expected to take the least
+ * time per generation: that of its last slice for the sparse engine, half
+ * of it for hashlife, which is about as fast on a slice twice as long.
+ * Hashlife is only left for a pattern which its counters show chaotic: a
+ * memo hit rate below ADAPT_HIT_MIN, or new nodes at each generation. It
+ * is tried again every ADAPT_REPROBE sparse slices, as ash settles.
+ * Slices double while the engine is kept, so that hashlife still takes
+ * exponential strides. */
+
+#define ADAPT_FIRST 6         // first slice of 2^6 generations
+#define ADAPT_SPARSE_MAX 14   // sparse slices of at most 2^14 generations
+#define ADAPT_SPARSE_DEPTH 28 // wider patterns stay in hashlife
+#define ADAPT_HIT_MIN 0.8
+#define ADAPT_GROWTH_MIN 1.0  // new nodes per generation
+#define ADAPT_REPROBE 4
+
+// Generation t of q, in the frame of destiny(): the original top-left
+// corner is at (2^e, 2^e), with e >= e_min.
+// A line is written to log (if not NULL) at each change of engine.
+Quad *adaptive_destiny(
+  Hashtbl *htbl,
+  Quad *q,
+  const BigInt *t,
+  int e_min,
+  int *e,
+  FILE *log);
+
+#endif
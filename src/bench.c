@@ -0,0 +1,431 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "definitions.h"
+#include "bigint.h"
+#include "hashtbl.h"
+#include "hashlife.h"
+#include "lifecount.h"
+#include "conversion.h"
+#include "prgrph.h"
+#include "runlength.h"
+
+/* End-to-end benchmark over the patterns/ corpus.
+ *
+ * Every (pattern, t) case runs destiny() in a separate process, so that
+ * its peak memory is measured on its own. The results are written as
+ * tab separated values, and compared to a baseline file if one is given:
+ * a case is a regression when its median time exceeds the baseline by
+ * more than the threshold, and a mismatch when its population differs. */
+
+#define BENCH_LADDER 4
+#define SOUP_SIDE 256
+
+struct Bench_case
+{
+  const char *name;
+  const char *file;      // in the patterns directory, NULL for a soup
+  unsigned    soup_seed;
+  const char *t[BENCH_LADDER];
+};
+
+const struct Bench_case bench_cases[] = {
+  {"glider_gun", "glider_gun.txt", 0, {"1000", "1000000", "1000000000", "1000000000000000"}},
+  {"line",       "line.rle",       0, {"1000", "1000000", "1000000000", "1000000000000"}},
+  {"max",        "max.rle",        0, {"1000", "1000000", "1000000000", "1000000000000"}},
+  {"soup1",      NULL,             1, {"1000", "100000", "1000000000", NULL}},
+  {"soup2",      NULL,             2, {"1000", "100000", "1000000000", NULL}},
+  {"soup3",      NULL,             3, {"1000", "100000", "1000000000", NULL}},
+};
+
+const int bench_cases_c = sizeof(bench_cases) / sizeof(struct Bench_case);
+
+struct Bench_result
+{
+  char   name[32];
+  char   t[32];
+  double wall;      // seconds, median over the repetitions
+  long   nodes;
+  long   memo_hits;
+  long   memo_misses;
+  long   peak_rss;  // KB, maximum over the repetitions
+  char   pop[48];   // log2 and lowest bits of the final population
+};
+
+const rule bench_rule = 6152; // b3/s23
+
+Quad  *bench_load(Hashtbl *htbl, const char *dir, const struct Bench_case *bc);
+Prgrph soup(unsigned seed, int side);
+
+int  bench_run(const char *dir, const struct Bench_case *bc, const char *t,
+               int reps, struct Bench_result *res);
+void bench_child(int fd, const char *dir, const struct Bench_case *bc,
+                 const char *t);
+
+void bench_write(FILE *file, const struct Bench_result *res);
+int  bench_compare(const char *baseline, struct Bench_result *res, int len,
+                   double threshold);
+
+int    cmp_double(const void *a, const void *b);
+
+/**************************************************/
+
+int main(int argc, char *argv[])
+{
+  const char *dir = "../patterns", *out = "bench_results.tsv",
+             *baseline = NULL, *filter = NULL;
+  double threshold = 0.10;
+  int reps = 3, opt;
+
+  while ( (opt = getopt(argc, argv, "p:o:b:r:n:f:")) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'p': dir = optarg; break;
+      case 'o': out = optarg; break;
+      case 'b': baseline = optarg; break;
+      case 'r': threshold = atof(optarg); break;
+      case 'n': reps = atoi(optarg); break;
+      case 'f': filter = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-p patterns_dir] [-o results] "
+                        "[-b baseline] [-r threshold] [-n repetitions] "
+                        "[-f case_filter]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if ( reps < 1 )
+    reps = 1;
+
+  struct Bench_result *res =
+    malloc(bench_cases_c * BENCH_LADDER * sizeof(struct Bench_result));
+
+  if ( !res )
+  {
+    perror("main()");
+    exit(1);
+  }
+
+  int i, j, len = 0;
+
+  printf("%-12s %18s %10s %14s %10s %10s %10s\n",
+         "case", "t", "wall_s", "gens/s", "nodes", "memo_hits", "rss_kb");
+
+  for ( i = 0 ; i < bench_cases_c ; i++ )
+  {
+    const struct Bench_case *bc = &bench_cases[i];
+
+    if ( filter && !strstr(bc->name, filter) )
+      continue;
+
+    for ( j = 0 ; j < BENCH_LADDER && bc->t[j] ; j++ )
+    {
+      if ( !bench_run(dir, bc, bc->t[j], reps, &res[len]) )
+        continue;
+
+      printf("%-12s %18s %10.4f %14.4g %10ld %10ld %10ld\n",
+             res[len].name, res[len].t, res[len].wall,
+             atof(res[len].t) / res[len].wall,
+             res[len].nodes, res[len].memo_hits, res[len].peak_rss);
+      fflush(stdout);
+
+      len++;
+    }
+  }
+
+  FILE *file = fopen(out, "w");
+
+  if ( !file )
+  {
+    perror(out);
+    exit(1);
+  }
+
+  fprintf(file, "case\tt\twall_s\tgens_per_s\tnodes\tmemo_hits\t"
+                "memo_misses\tpeak_rss_kb\tpop\n");
+  for ( i = 0 ; i < len ; i++ )
+    bench_write(file, &res[i]);
+
+  fclose(file);
+
+  int status = baseline ? bench_compare(baseline, res, len, threshold) : 0;
+
+  free(res);
+
+  return status;
+}
+
+/*** Cases ***/
+
+Quad *bench_load(Hashtbl *htbl, const char *dir, const struct Bench_case *bc)
+{
+  if ( !bc->file )
+  {
+    Prgrph p = soup(bc->soup_seed, SOUP_SIDE);
+    Quad *q = prgrph_to_quad(htbl, p);
+
+    free_prgrph(p);
+    return q;
+  }
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", dir, bc->file);
+
+  FILE *file = fopen(path, "r");
+
+  if ( !file )
+  {
+    perror(path);
+    return NULL;
+  }
+
+  Quad *q = NULL;
+  const size_t len = strlen(bc->file);
+
+  if ( len > 4 && strcmp(bc->file + len - 4, ".rle") == 0 )
+  {
+    Rle *rle = read_rle(file);
+
+    if ( rle )
+    {
+      q = rle_to_quad(htbl, rle);
+      free_rle(rle);
+    }
+  }
+  else
+  {
+    Prgrph p = read_prgrph(file);
+
+    if ( p.m >= 0 )
+    {
+      q = prgrph_to_quad(htbl, p);
+      free_prgrph(p);
+    }
+  }
+
+  fclose(file);
+
+  return q;
+}
+
+// Random square of side cells, half of them alive
+Prgrph soup(unsigned seed, int side)
+{
+  Prgrph p;
+  uint32_t x = 2463534242u ^ seed;
+
+  p.prgrph = alloc_prgrph(side, side, sizeof(char));
+  p.m = side;
+
+  if ( !p.prgrph )
+  {
+    perror("soup()");
+    exit(1);
+  }
+
+  int i, j;
+  for ( i = 0 ; i < side ; i++ )
+    for ( j = 0 ; j < side ; j++ )
+    {
+      // xorshift32
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      p.prgrph[i][j] = x >> 31 ? ALIVE : DEAD;
+    }
+
+  return p;
+}
+
+/*** Measures ***/
+
+int bench_run(const char *dir, const struct Bench_case *bc, const char *t,
+              int reps, struct Bench_result *res)
+{
+  double *walls = malloc(reps * sizeof(double));
+
+  if ( !walls )
+  {
+    perror("bench_run()");
+    exit(1);
+  }
+
+  snprintf(res->name, sizeof(res->name), "%s", bc->name);
+  snprintf(res->t, sizeof(res->t), "%s", t);
+  res->peak_rss = 0;
+
+  int r;
+  for ( r = 0 ; r < reps ; r++ )
+  {
+    int fd[2];
+
+    if ( pipe(fd) )
+    {
+      perror("bench_run()");
+      exit(1);
+    }
+
+    pid_t pid = fork();
+
+    if ( pid < 0 )
+    {
+      perror("bench_run()");
+      exit(1);
+    }
+    else if ( pid == 0 )
+    {
+      close(fd[0]);
+      bench_child(fd[1], dir, bc, t);
+      _exit(0);
+    }
+
+    close(fd[1]);
+
+    char line[256];
+    FILE *in = fdopen(fd[0], "r");
+    int ok = in && fgets(line, sizeof(line), in) &&
+             sscanf(line, "%lf %ld %ld %ld %47s", &walls[r], &res->nodes,
+                    &res->memo_hits, &res->memo_misses, res->pop) == 5;
+
+    if ( in )
+      fclose(in);
+
+    int status;
+    struct rusage ru;
+
+    wait4(pid, &status, 0, &ru);
+
+    if ( !ok || !WIFEXITED(status) || WEXITSTATUS(status) )
+    {
+      fprintf(stderr, "bench: case %s t=%s failed\n", bc->name, t);
+      free(walls);
+      return 0;
+    }
+
+    if ( ru.ru_maxrss > res->peak_rss )
+      res->peak_rss = ru.ru_maxrss;
+  }
+
+  qsort(walls, reps, sizeof(double), cmp_double);
+  res->wall = walls[reps / 2];
+
+  free(walls);
+  return 1;
+}
+
+// The creation of the table and the loading are timed with the evolution,
+// so that work moved between them does not show as a change
+void bench_child(int fd, const char *dir, const struct Bench_case *bc,
+                 const char *t)
+{
+  BigInt *bi = bi_from_string(t, 10);
+  int shift_e;
+
+  double start = stats_now();
+  Hashtbl *htbl = hashtbl_new(bench_rule);
+  Quad *q = bench_load(htbl, dir, bc);
+
+  if ( !q )
+    _exit(1);
+
+  q = destiny(htbl, q, bi, &shift_e);
+  double wall = stats_now() - start;
+
+  const BigInt *pop = cell_count(htbl, q);
+  Stats *stats = hashtbl_stats(htbl);
+
+  dprintf(fd, "%.6f %d %ld %ld %d:%d\n", wall, hashtbl_count(htbl),
+          stats->fate_hits, stats->fate_misses,
+          bi_log2(pop), bi_slice(pop, 0));
+
+  close(fd);
+}
+
+/*** Results ***/
+
+void bench_write(FILE *file, const struct Bench_result *res)
+{
+  fprintf(file, "%s\t%s\t%.6f\t%.6g\t%ld\t%ld\t%ld\t%ld\t%s\n",
+          res->name, res->t, res->wall, atof(res->t) / res->wall,
+          res->nodes, res->memo_hits, res->memo_misses, res->peak_rss,
+          res->pop);
+}
+
+// Returns 1 if some case regressed or changed its result
+int bench_compare(const char *baseline, struct Bench_result *res, int len,
+                  double threshold)
+{
+  // Differences below this are considered as noise
+  const double min_wall_diff = 0.005;
+
+  FILE *file = fopen(baseline, "r");
+
+  if ( !file )
+  {
+    perror(baseline);
+    return 1;
+  }
+
+  char line[512];
+  int status = 0, i;
+
+  printf("\nComparison with %s (threshold %.0f%%)\n", baseline, 100 * threshold);
+
+  // Skip the header
+  if ( !fgets(line, sizeof(line), file) )
+    line[0] = '\0';
+
+  while ( fgets(line, sizeof(line), file) )
+  {
+    struct Bench_result b;
+    double gps;
+
+    if ( sscanf(line, "%31s %31s %lf %lf %ld %ld %ld %ld %47s", b.name, b.t,
+                &b.wall, &gps, &b.nodes, &b.memo_hits, &b.memo_misses,
+                &b.peak_rss, b.pop) != 9 )
+      continue;
+
+    for ( i = 0 ; i < len ; i++ )
+    {
+      if ( strcmp(res[i].name, b.name) || strcmp(res[i].t, b.t) )
+        continue;
+
+      const char *verdict = "ok";
+
+      if ( strcmp(res[i].pop, b.pop) )
+      {
+        verdict = "MISMATCH";
+        status = 1;
+      }
+      else if ( res[i].wall > b.wall * (1 + threshold)
+             && res[i].wall - b.wall > min_wall_diff )
+      {
+        verdict = "REGRESSION";
+        status = 1;
+      }
+
+      printf("%-12s %18s %10.4f -> %10.4f (%+6.1f%%) %s\n",
+             b.name, b.t, b.wall, res[i].wall,
+             100 * (res[i].wall - b.wall) / b.wall, verdict);
+    }
+  }
+
+  fclose(file);
+
+  return status;
+}
+
+int cmp_double(const void *a, const void *b)
+{
+  const double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
@@ -105,6 +105,20 @@ int bi_iszero(const BigInt *b)
   return b->len == 0;
 }
 
+// Both arguments are canonical, so that a longer number is a greater one
+int bi_cmp(const BigInt *a, const BigInt *b)
+{
+  if ( a->len != b->len )
+    return a->len < b->len ? -1 : 1;
+
+  int i;
+  for ( i = a->len - 1 ; i >= 0 ; i-- )
+    if ( a->digits[i] != b->digits[i] )
+      return a->digits[i] < b->digits[i] ? -1 : 1;
+
+  return 0;
+}
+
 BigInt *bi_copy(const BigInt *b)
 {
   if ( bi_iszero(b) )
@@ -307,6 +321,33 @@ BigInt *bi_add(const BigInt *a, const BigInt *b)
   return c;
 }
 
+BigInt *bi_sub(const BigInt *a, const BigInt *b)
+{
+  if ( bi_iszero(a) )
+    return bi_zero();
+
+  BigInt *c = bi_new(a->len);
+
+  if ( !c )
+  {
+    perror("bi_sub()");
+    exit(1);
+  }
+
+  int i, borrow = 0;
+  for ( i = 0 ; i < a->len ; i++ )
+  {
+    const bi_block bd = i < b->len ? b->digits[i] : 0;
+
+    c->digits[i] = a->digits[i] - bd - borrow;
+    borrow = a->digits[i] < bd || (a->digits[i] == bd && borrow);
+  }
+
+  bi_canonize(c);
+
+  return c;
+}
+
 int bi_to_int(const BigInt *b)
 {
   return b->len ? b->digits[0] : 0;
@@ -332,6 +373,31 @@ BigInt *bi_from_int(int i)
   }
 }
 
+uint64_t bi_to_u64(const BigInt *b)
+{
+  return b->len ? b->digits[0] : 0;
+}
+
+BigInt *bi_from_u64(uint64_t i)
+{
+  if ( i == 0 )
+    return bi_zero();
+  else
+  {
+    BigInt *s = bi_new(1);
+
+    if ( s == NULL )
+    {
+      perror("bi_from_u64()");
+      exit(1);
+    }
+
+    s->digits[0] = i;
+
+    return s;
+  }
+}
+
 BigInt *bi_mult_int(const BigInt *b, int n);
 
 BigInt *bi_from_string(const char *c, int base)
@@ -376,6 +442,25 @@ BigInt *bi_mult_int(const BigInt *b, int n)
   return acc;
 }
 
+size_t bi_packed_size(const BigInt *b)
+{
+  return sizeof(BigInt) + b->len * sizeof(bi_block);
+}
+
+BigInt *bi_pack(const BigInt *b, void *mem)
+{
+  BigInt *c = mem;
+
+  c->len    = b->len;
+  c->digits = b->len ? (bi_block *) (c + 1) : NULL;
+
+  int i;
+  for ( i = 0 ; i < b->len ; i++ )
+    c->digits[i] = b->digits[i];
+
+  return c;
+}
+
 void bi_free(BigInt *b)
 {
   if ( b->digits )
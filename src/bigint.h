@@ -1,18 +1,22 @@
 #ifndef BIGINT_H
 #define BIGINT_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 struct BigInt;
 
 typedef struct BigInt BigInt;
 
 BigInt *bi_zero(void);
 
-const BigInt *bi_zero_const;
+extern const BigInt *bi_zero_const;
 
 int bi_log2(const BigInt *b);
 int bi_slice(const BigInt *b, int c); // get 31 bits starting from the c-th
 int bi_digit(const BigInt *b, int d);
 int bi_iszero(const BigInt *b);
+int bi_cmp(const BigInt *a, const BigInt *b); // sign of a - b
 
 BigInt *bi_copy(const BigInt *b);
 
@@ -20,15 +24,25 @@ BigInt *bi_power_2(int k);
 BigInt *bi_plus_int(const BigInt *b, int i);
 BigInt *bi_minus_pow(const BigInt *b, int e, int *neg);
 BigInt *bi_add(const BigInt *a, const BigInt *b);
+BigInt *bi_sub(const BigInt *a, const BigInt *b); // assumes a >= b
 
 int     bi_to_int(const BigInt *b);
 BigInt *bi_from_int(int i);
 
+// Low 64 bits of b
+uint64_t bi_to_u64(const BigInt *b);
+BigInt  *bi_from_u64(uint64_t i);
+
 // Ignores isolated commas
 // "10,00", base=10 -> 1000 (0b111010000)
 // "10,,00", base=10 -> 10 (0b1010)
 BigInt *bi_from_string(const char *c, int base);
 
+// Copy of b in mem, which holds bi_packed_size(b) bytes aligned as a
+// pointer. It is released with mem, not with bi_free().
+size_t  bi_packed_size(const BigInt *b);
+BigInt *bi_pack(const BigInt *b, void *mem);
+
 void bi_free(BigInt *b);
 
 void bi_print(const BigInt *b);
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "hashtbl.h"
+#include "quadops.h"
+#include "celledit.h"
+
+struct Seq_edit
+{
+  Cell_edit e;
+  int       seq; // position in the original array
+};
+
+int   morton_cmp(const void *a, const void *b);
+Quad *quad_edit_(Hashtbl *htbl, Quad *q, struct Seq_edit *edits, int n);
+
+int   edit_quadrant(const Cell_edit *e, int d);
+
+/**************************************************/
+
+Quad *quad_edit(Hashtbl *htbl, Quad *q, const Cell_edit *edits, int n)
+{
+  if ( n == 0 )
+    return q;
+
+  struct Seq_edit *se = malloc(n * sizeof(struct Seq_edit));
+
+  if ( !se )
+  {
+    perror("quad_edit()");
+    exit(1);
+  }
+
+  uint64_t max = 0;
+
+  int i;
+  for ( i = 0 ; i < n ; i++ )
+  {
+    se[i].e   = edits[i];
+    se[i].seq = i;
+    max |= edits[i].x | edits[i].y;
+  }
+
+  // Depth such that all the edits are inside
+  int d = 0;
+  while ( d < 63 && max >> (d + 1) )
+    d++;
+
+  q = quad_pad(htbl, q, d);
+
+  // Edits of a same subtree are contiguous in Morton order
+  qsort(se, n, sizeof(struct Seq_edit), morton_cmp);
+
+  // Keep the last edit of each cell
+  int len = 0;
+  for ( i = 0 ; i < n ; i++ )
+  {
+    if ( len > 0 && se[len-1].e.x == se[i].e.x && se[len-1].e.y == se[i].e.y )
+      se[len-1] = se[i];
+    else
+      se[len++] = se[i];
+  }
+
+  q = quad_edit_(htbl, q, se, len);
+
+  free(se);
+
+  return q;
+}
+
+/*** Auxiliary functions ***/
+
+// Order of the leaves in a depth first traversal,
+// then order of the edits
+int morton_cmp(const void *a, const void *b)
+{
+  const struct Seq_edit *sa = a, *sb = b;
+
+  uint64_t dx = sa->e.x ^ sb->e.x,
+           dy = sa->e.y ^ sb->e.y;
+
+  // The row bit is the most significant one at each level
+  if ( dy && (dy >= dx || dy >= (dx ^ dy)) )
+    return sa->e.y < sb->e.y ? -1 : 1;
+  else if ( dx )
+    return sa->e.x < sb->e.x ? -1 : 1;
+  else
+    return sa->seq - sb->seq;
+}
+
+// edits are sorted, distinct, and inside q
+Quad *quad_edit_(Hashtbl *htbl, Quad *q, struct Seq_edit *edits, int n)
+{
+  if ( n == 0 )
+    return q;
+  else if ( q->depth == 0 )
+  {
+    int i, l = 0;
+    for ( i = 0 ; i < 4 ; i++ )
+      l |= q->node.l.map[i] << (3 - i);
+
+    for ( i = 0 ; i < n ; i++ )
+    {
+      const int bit = 1 << (3 - edit_quadrant(&edits[i].e, 0));
+
+      l = edits[i].e.state ? l | bit : l & ~bit;
+    }
+
+    return leaf(l);
+  }
+
+  Quad *quad[4];
+
+  int i, j = 0;
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    int k = j;
+
+    while ( k < n && edit_quadrant(&edits[k].e, q->depth) == i )
+      k++;
+
+    quad[i] = quad_edit_(htbl, q->node.n.sub[i], edits + j, k - j);
+    j = k;
+  }
+
+  return cons_quad(htbl, quad, q->depth);
+}
+
+// Subtree of a node of depth d containing the edited cell
+int edit_quadrant(const Cell_edit *e, int d)
+{
+  if ( d >= 64 )
+    return 0;
+
+  return 2 * ((e->y >> d) & 1) + ((e->x >> d) & 1);
+}
@@ -0,0 +1,23 @@
+#ifndef CELLEDIT_H
+#define CELLEDIT_H
+
+#include <stdint.h>
+#include "hashtbl.h"
+
+/* Setting and clearing cells of an existing tree.
+ * Only the paths from the root to the edited cells are rebuilt,
+ * other subtrees (and their memoized results) are kept. */
+
+// x increasing towards the right, y towards the bottom,
+// the origin is the top-left corner of the tree
+typedef struct Cell_edit
+{
+  uint64_t x, y;
+  int      state; // 0: dead, 1: alive
+} Cell_edit;
+
+// Apply n edits, the tree is padded if some are outside of it.
+// When a cell is edited several times, the last edit in the array wins.
+Quad *quad_edit(Hashtbl *htbl, Quad *q, const Cell_edit *edits, int n);
+
+#endif
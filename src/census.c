@@ -0,0 +1,781 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "definitions.h"
+#include "darray.h"
+#include "bigint.h"
+#include "hashtbl.h"
+#include "lifecount.h"
+#include "simulation.h"
+#include "rulelut.h"
+#include "rulekernel.h"
+#include "soup.h"
+#include "census.h"
+
+#define CENSUS_MARGIN 24       // around the soups in the lanes
+#define LANES_MAX_GEN 2000
+#define HASHLIFE_JUMP 256      // between two periodicity checks
+#define HASHLIFE_MAX_GEN 65536
+#define SETTLE_WINDOW (2 * CENSUS_PERIOD_MAX)
+#define SETTLE_LCM 120         // multiple of the common periods of the ash
+#define CENSUS_TABLE_SIZE (1 << 22) // buckets of the hashtables
+#define CANVAS 64              // rows of 64 cells, to evolve an object
+
+typedef struct Census_entry
+{
+  char                *name;
+  long                 n;
+  struct Census_entry *next;
+} Census_entry;
+
+struct Census
+{
+  int            size;
+  int            count;
+  Census_entry **tbl;
+  long           soups;
+  long           lanes;     // settled in the lanes
+  long           hashlife;  // settled in hashlife
+  long           unsettled;
+};
+
+typedef struct Cell
+{
+  int x, y;
+} Cell;
+
+// Shared by the threads of a search
+typedef struct Search
+{
+  rule             r;
+  uint64_t         base;  // hash of the seed
+  long             next;  // first soup of the next batch
+  long             end;
+  pthread_mutex_t  lock;
+  Census          *total;
+} Search;
+
+// An object, its rows shifted to the top-left corner
+typedef struct Form
+{
+  uint64_t rows[CANVAS];
+  int      w, h, x, y, pop;
+} Form;
+
+void *search_thread(void *arg);
+void  search_batch(Census *c, Hashtbl *htbl, Soup *s,
+                   const Rule_kernel *k, uint64_t base, long first, int n);
+int   settle(Hashtbl *htbl, Quad *q, Darray *cells);
+void  quad_cells(Hashtbl *htbl, Quad *q, int x, int y, Darray *cells);
+void  census_cells(Census *c, const Rule_kernel *k, Cell *cells, int n);
+int   uf_find(int *parent, int i);
+int   cmp_cell_x(const void *a, const void *b);
+int   cmp_int_pair(const void *a, const void *b);
+void  canvas_step(const Rule_kernel *k, uint64_t rows[CANVAS]);
+int   canvas_form(const uint64_t rows[CANVAS], Form *f);
+int   form_equal(const Form *a, const Form *b);
+void  wechsler(const Form *f, int sym, char *buf);
+uint64_t seed_hash(const char *seed);
+
+/**************************************************/
+
+Census *census_new(void)
+{
+  Census *c = malloc(sizeof(Census));
+
+  if ( !c )
+  {
+    perror("census_new()");
+    exit(1);
+  }
+
+  c->size = 256;
+  c->count = 0;
+  c->tbl = calloc(c->size, sizeof(Census_entry *));
+  c->soups = c->lanes = c->hashlife = c->unsettled = 0;
+
+  if ( !c->tbl )
+  {
+    perror("census_new()");
+    exit(1);
+  }
+
+  return c;
+}
+
+void census_free(Census *c)
+{
+  int i;
+
+  for ( i = 0 ; i < c->size ; i++ )
+  {
+    Census_entry *e = c->tbl[i], *next;
+
+    for ( ; e ; e = next )
+    {
+      next = e->next;
+      free(e->name);
+      free(e);
+    }
+  }
+
+  free(c->tbl);
+  free(c);
+}
+
+void census_add(Census *c, const char *name, long n)
+{
+  const int h = seed_hash(name) & (c->size - 1);
+  Census_entry *e;
+
+  for ( e = c->tbl[h] ; e ; e = e->next )
+    if ( strcmp(e->name, name) == 0 )
+    {
+      e->n += n;
+      return;
+    }
+
+  e = malloc(sizeof(Census_entry));
+
+  if ( !e || !(e->name = strdup(name)) )
+  {
+    perror("census_add()");
+    exit(1);
+  }
+
+  e->n = n;
+  e->next = c->tbl[h];
+  c->tbl[h] = e;
+  c->count++;
+}
+
+void census_merge(Census *dst, const Census *src)
+{
+  int i;
+
+  for ( i = 0 ; i < src->size ; i++ )
+  {
+    const Census_entry *e;
+
+    for ( e = src->tbl[i] ; e ; e = e->next )
+      census_add(dst, e->name, e->n);
+  }
+
+  dst->soups += src->soups;
+  dst->lanes += src->lanes;
+  dst->hashlife += src->hashlife;
+  dst->unsettled += src->unsettled;
+}
+
+void census_print(FILE *out, const Census *c)
+{
+  Census_entry **all = malloc((c->count + 1) * sizeof(Census_entry *));
+  int i, n = 0;
+
+  if ( !all )
+  {
+    perror("census_print()");
+    exit(1);
+  }
+
+  for ( i = 0 ; i < c->size ; i++ )
+  {
+    Census_entry *e;
+
+    for ( e = c->tbl[i] ; e ; e = e->next )
+      all[n++] = e;
+  }
+
+  // Insertion sort, by decreasing count then name
+  for ( i = 1 ; i < n ; i++ )
+  {
+    Census_entry *e = all[i];
+    int j;
+
+    for ( j = i ; j > 0 && (all[j-1]->n < e->n
+            || (all[j-1]->n == e->n && strcmp(all[j-1]->name, e->name) > 0)) ; j-- )
+      all[j] = all[j-1];
+
+    all[j] = e;
+  }
+
+  fprintf(out, "soups %ld (lanes %ld, hashlife %ld, unsettled %ld)\n",
+    c->soups, c->lanes, c->hashlife, c->unsettled);
+  fprintf(out, "objects %ld, distinct %d\n", census_objects(c), c->count);
+
+  for ( i = 0 ; i < n ; i++ )
+    fprintf(out, "%12ld %s\n", all[i]->n, all[i]->name);
+
+  free(all);
+}
+
+long census_soups(const Census *c)
+{
+  return c->soups;
+}
+
+long census_objects(const Census *c)
+{
+  long n = 0;
+  int i;
+
+  for ( i = 0 ; i < c->size ; i++ )
+  {
+    const Census_entry *e;
+
+    for ( e = c->tbl[i] ; e ; e = e->next )
+      n += e->n;
+  }
+
+  return n;
+}
+
+void census_search(
+  Census *c,
+  rule r,
+  const char *seed,
+  long first,
+  long n,
+  int threads)
+{
+  Search se;
+  pthread_t *th = malloc(threads * sizeof(pthread_t));
+  int i;
+
+  if ( !th )
+  {
+    perror("census_search()");
+    exit(1);
+  }
+
+  se.r = r;
+  se.base = seed_hash(seed);
+  se.next = first;
+  se.end = first + n;
+  se.total = c;
+  pthread_mutex_init(&se.lock, NULL);
+
+  // The table of the rule is computed once, before the threads
+  rule_lut(r);
+
+  for ( i = 0 ; i < threads ; i++ )
+    if ( pthread_create(&th[i], NULL, search_thread, &se) )
+    {
+      perror("census_search()");
+      exit(1);
+    }
+
+  for ( i = 0 ; i < threads ; i++ )
+    pthread_join(th[i], NULL);
+
+  pthread_mutex_destroy(&se.lock);
+  free(th);
+}
+
+void census_name(
+  const Rule_kernel *k,
+  const int *x,
+  const int *y,
+  int n,
+  char *name)
+{
+  int xmin = x[0], xmax = x[0], ymin = y[0], ymax = y[0], i, p, sym;
+
+  for ( i = 1 ; i < n ; i++ )
+  {
+    if ( x[i] < xmin ) xmin = x[i];
+    if ( x[i] > xmax ) xmax = x[i];
+    if ( y[i] < ymin ) ymin = y[i];
+    if ( y[i] > ymax ) ymax = y[i];
+  }
+
+  // Room to evolve it without reaching the border of the canvas
+  if ( xmax - xmin >= CANVAS - 24 || ymax - ymin >= CANVAS - 24 )
+  {
+    sprintf(name, "ov_s%d", n);
+    return;
+  }
+
+  uint64_t rows[CANVAS] = {0};
+  Form forms[CENSUS_PERIOD_MAX + 1];
+
+  for ( i = 0 ; i < n ; i++ )
+    rows[y[i] - ymin + 12] |= (uint64_t) 1 << (x[i] - xmin + 12);
+
+  canvas_form(rows, &forms[0]);
+
+  int found = 0;
+
+  // Smallest period, the phases being compared up to a translation
+  for ( p = 1 ; p <= CENSUS_PERIOD_MAX && !found ; p++ )
+  {
+    canvas_step(k, rows);
+
+    if ( !canvas_form(rows, &forms[p]) )
+      break;
+
+    found = form_equal(&forms[p], &forms[0]);
+  }
+
+  if ( !found )
+  {
+    sprintf(name, "zz_s%d", n);
+    return;
+  }
+
+  char best[CENSUS_NAME_MAX], code[CENSUS_NAME_MAX];
+  int len = 0;
+
+  best[0] = '\0';
+
+  // Shortest code, then first in ASCII order
+  p--;
+
+  for ( i = 0 ; i < p ; i++ )
+    for ( sym = 0 ; sym < 8 ; sym++ )
+    {
+      wechsler(&forms[i], sym, code);
+
+      const int l = strlen(code);
+
+      if ( !best[0] || l < len || (l == len && strcmp(code, best) < 0) )
+      {
+        strcpy(best, code);
+        len = l;
+      }
+    }
+
+  if ( p == 1 )
+    sprintf(name, "xs%d_%s", n, best);
+  else if ( forms[p].x != forms[0].x || forms[p].y != forms[0].y )
+    sprintf(name, "xq%d_%s", p, best);
+  else
+    sprintf(name, "xp%d_%s", p, best);
+}
+
+/*** Auxiliary functions ***/
+
+void *search_thread(void *arg)
+{
+  Search *se = arg;
+  Hashtbl *htbl = hashtbl_new_sized(se->r, CENSUS_TABLE_SIZE);
+  Soup *s = soup_new(se->r, CENSUS_SIDE, CENSUS_MARGIN);
+  const Rule_kernel *k = rule_lut_kernel(rule_lut(se->r));
+  Census *c = census_new();
+
+  // The nodes of the past soups are dropped by the compactions of the
+  // simulations
+  hashtbl_set_compaction(htbl, 1);
+
+  for ( ;; )
+  {
+    pthread_mutex_lock(&se->lock);
+
+    const long first = se->next;
+    se->next += SOUP_LANES;
+
+    pthread_mutex_unlock(&se->lock);
+
+    if ( first >= se->end )
+      break;
+
+    search_batch(c, htbl, s, k, se->base, first,
+      se->end - first < SOUP_LANES ? se->end - first : SOUP_LANES);
+  }
+
+  pthread_mutex_lock(&se->lock);
+  census_merge(se->total, c);
+  pthread_mutex_unlock(&se->lock);
+
+  census_free(c);
+  soup_free(s);
+  free_hashtbl(htbl);
+
+  return NULL;
+}
+
+// The soups first to first + n - 1 in the lanes of s
+void search_batch(Census *c, Hashtbl *htbl, Soup *s,
+                  const Rule_kernel *k, uint64_t base, long first, int n)
+{
+  int l, i, j;
+
+  soup_clear(s);
+
+  for ( l = 0 ; l < n ; l++ )
+    soup_seed(s, l, base ^ (uint64_t) (first + l) * 0x9E3779B97F4A7C15ull);
+
+  soup_run(s, LANES_MAX_GEN);
+
+  const uint64_t done = soup_stable(s) & ~soup_escaped(s);
+  const int grid = soup_grid(s);
+
+  for ( l = 0 ; l < n ; l++ )
+  {
+    Darray *da = da_new(sizeof(Cell));
+    int len;
+
+    if ( done >> l & 1 )
+    {
+      for ( i = 0 ; i < grid ; i++ )
+        for ( j = 0 ; j < grid ; j++ )
+          if ( soup_cell(s, l, i, j) )
+          {
+            Cell cell = {j, i};
+            da_push(da, &cell);
+          }
+
+      c->lanes++;
+    }
+    else if ( settle(htbl, soup_quad(s, htbl, l, 1), da) )
+      c->hashlife++;
+    else
+      c->unsettled++;
+
+    Cell *cells = da_unpack(da, &len);
+
+    // The ash of an unsettled soup is counted as it is
+    if ( len )
+      census_cells(c, k, cells, len);
+
+    free(cells);
+    c->soups++;
+  }
+}
+
+// Evolves q until its population is periodic (up to CENSUS_PERIOD_MAX),
+// with the same period and sum over a period at two successive checks,
+// then adds its cells. Returns 0 if it does not settle within
+// HASHLIFE_MAX_GEN generations, the cells are then those of the last one.
+int settle(Hashtbl *htbl, Quad *q, Darray *cells)
+{
+  Sim *sim = sim_new(htbl, q);
+  BigInt *jump = bi_from_int(HASHLIFE_JUMP), *one = bi_from_int(1),
+         *lcm = bi_from_int(SETTLE_LCM);
+  long gen = 0, prev_sum = -1;
+  int prev_p = 0, ok = 0;
+
+  // Never goes back
+  sim_set_history(sim, 0);
+
+  while ( !ok && gen < HASHLIFE_MAX_GEN )
+  {
+    int pop[SETTLE_WINDOW], i, p;
+    long sum = 0;
+
+    sim_advance(sim, jump);
+    gen += HASHLIFE_JUMP;
+
+    // Cheap test first: the same population SETTLE_LCM generations later
+    const int before = bi_to_int(cell_count(htbl, sim_current(sim)->root));
+
+    sim_advance(sim, lcm);
+    gen += SETTLE_LCM;
+
+    if ( bi_to_int(cell_count(htbl, sim_current(sim)->root)) != before )
+    {
+      prev_p = 0;
+      continue;
+    }
+
+    for ( i = 0 ; i < SETTLE_WINDOW ; i++ )
+    {
+      pop[i] = bi_to_int(cell_count(htbl, sim_current(sim)->root));
+      sim_advance(sim, one);
+      gen++;
+    }
+
+    for ( p = 1 ; p <= CENSUS_PERIOD_MAX ; p++ )
+    {
+      for ( i = 0 ; i + p < SETTLE_WINDOW && pop[i] == pop[i + p] ; i++ )
+        ;
+
+      if ( i + p == SETTLE_WINDOW )
+        break;
+    }
+
+    if ( p <= CENSUS_PERIOD_MAX )
+    {
+      for ( i = 0 ; i < p ; i++ )
+        sum += pop[i];
+
+      ok = p == prev_p && sum == prev_sum;
+    }
+    else
+      p = 0;
+
+    prev_p = p;
+    prev_sum = sum;
+  }
+
+  quad_cells(htbl, sim_current(sim)->root, 0, 0, cells);
+
+  bi_free(jump);
+  bi_free(one);
+  bi_free(lcm);
+  sim_free(sim);
+
+  return ok;
+}
+
+// Live cells of q, its top-left corner at (x, y)
+void quad_cells(Hashtbl *htbl, Quad *q, int x, int y, Darray *cells)
+{
+  int i;
+
+  if ( q == dead_space(htbl, q->depth) )
+    return;
+
+  if ( q->depth == 0 )
+  {
+    for ( i = 0 ; i < 4 ; i++ )
+      if ( q->node.l.map[i] )
+      {
+        Cell cell = {x + (i & 1), y + (i >> 1)};
+        da_push(cells, &cell);
+      }
+
+    return;
+  }
+
+  for ( i = 0 ; i < 4 ; i++ )
+    quad_cells(htbl, q->node.n.sub[i],
+      x + ((i & 1) << q->depth), y + ((i >> 1) << q->depth), cells);
+}
+
+// Splits the cells into objects (cells within distance 2), names them
+void census_cells(Census *c, const Rule_kernel *k, Cell *cells, int n)
+{
+  int *parent = malloc(n * sizeof(int)),
+      *order = malloc(2 * n * sizeof(int)),
+      *x = malloc(n * sizeof(int)),
+      *y = malloc(n * sizeof(int));
+  char name[CENSUS_NAME_MAX];
+  int i, j;
+
+  if ( !parent || !order || !x || !y )
+  {
+    perror("census_cells()");
+    exit(1);
+  }
+
+  qsort(cells, n, sizeof(Cell), cmp_cell_x);
+
+  for ( i = 0 ; i < n ; i++ )
+    parent[i] = i;
+
+  for ( i = 0 ; i < n ; i++ )
+    for ( j = i + 1 ; j < n && cells[j].x - cells[i].x <= 2 ; j++ )
+      if ( abs(cells[j].y - cells[i].y) <= 2 )
+        parent[uf_find(parent, j)] = uf_find(parent, i);
+
+  // Pairs (object, cell), the cells of an object are then contiguous
+  for ( i = 0 ; i < n ; i++ )
+  {
+    order[2 * i] = uf_find(parent, i);
+    order[2 * i + 1] = i;
+  }
+
+  qsort(order, n, 2 * sizeof(int), cmp_int_pair);
+
+  for ( i = 0 ; i < n ; i = j )
+  {
+    for ( j = i ; j < n && order[2 * j] == order[2 * i] ; j++ )
+    {
+      x[j - i] = cells[order[2 * j + 1]].x;
+      y[j - i] = cells[order[2 * j + 1]].y;
+    }
+
+    census_name(k, x, y, j - i, name);
+    census_add(c, name, 1);
+  }
+
+  free(parent);
+  free(order);
+  free(x);
+  free(y);
+}
+
+int uf_find(int *parent, int i)
+{
+  while ( parent[i] != i )
+    i = parent[i] = parent[parent[i]];
+
+  return i;
+}
+
+int cmp_cell_x(const void *a, const void *b)
+{
+  const Cell *u = a, *v = b;
+
+  return u->x != v->x ? (u->x > v->x) - (u->x < v->x)
+                      : (u->y > v->y) - (u->y < v->y);
+}
+
+int cmp_int_pair(const void *a, const void *b)
+{
+  const int *u = a, *v = b;
+
+  return u[0] != v[0] ? (u[0] > v[0]) - (u[0] < v[0])
+                      : (u[1] > v[1]) - (u[1] < v[1]);
+}
+
+// One generation of the canvas, its border rows staying dead
+void canvas_step(const Rule_kernel *k, uint64_t rows[CANVAS])
+{
+  uint64_t res[CANVAS] = {0}, cnt[4][KERNEL_BATCH];
+  int i, b;
+
+  for ( i = 1 ; i < CANVAS - 1 ; i += KERNEL_BATCH )
+  {
+    const int n = CANVAS - 1 - i < KERNEL_BATCH ? CANVAS - 1 - i : KERNEL_BATCH;
+
+    for ( b = 0 ; b < n ; b++ )
+    {
+      const uint64_t u = rows[i + b - 1], m = rows[i + b], d = rows[i + b + 1];
+      const uint64_t nb[8] = { u << 1, u, u >> 1, m << 1, m >> 1, d << 1, d, d >> 1 };
+      uint64_t sum[4];
+
+      rule_kernel_count(nb, sum);
+
+      cnt[0][b] = sum[0];
+      cnt[1][b] = sum[1];
+      cnt[2][b] = sum[2];
+      cnt[3][b] = sum[3];
+    }
+
+    rule_kernel_apply(k, n, rows + i, cnt, res + i);
+  }
+
+  memcpy(rows, res, sizeof(res));
+}
+
+// Shifted to the top-left corner, 0 if empty or against the border
+int canvas_form(const uint64_t rows[CANVAS], Form *f)
+{
+  uint64_t all = 0;
+  int i, top = -1, bottom = -1;
+
+  f->pop = 0;
+
+  for ( i = 0 ; i < CANVAS ; i++ )
+    if ( rows[i] )
+    {
+      if ( top < 0 )
+        top = i;
+
+      bottom = i;
+      all |= rows[i];
+      f->pop += __builtin_popcountll(rows[i]);
+    }
+
+  if ( top <= 0 || bottom == CANVAS - 1 || (all & (1 | (uint64_t) 1 << 63)) )
+    return 0;
+
+  const int left = __builtin_ctzll(all);
+
+  f->x = left;
+  f->y = top;
+  f->w = 64 - __builtin_clzll(all) - left;
+  f->h = bottom - top + 1;
+
+  for ( i = 0 ; i < CANVAS ; i++ )
+    f->rows[i] = i < f->h ? rows[top + i] >> left : 0;
+
+  return 1;
+}
+
+int form_equal(const Form *a, const Form *b)
+{
+  int i;
+
+  if ( a->w != b->w || a->h != b->h || a->pop != b->pop )
+    return 0;
+
+  for ( i = 0 ; i < a->h ; i++ )
+    if ( a->rows[i] != b->rows[i] )
+      return 0;
+
+  return 1;
+}
+
+// Extended Wechsler code of the form under one of the 8 symmetries:
+// strips of 5 rows separated by 'z', one character per column of a
+// strip, runs of empty columns as '0', 'w', 'x' or 'y' and a count
+void wechsler(const Form *f, int sym, char *buf)
+{
+  const char chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  const int w = sym & 4 ? f->h : f->w, h = sym & 4 ? f->w : f->h;
+  int strip, u, k, n = 0;
+
+  for ( strip = 0 ; 5 * strip < h ; strip++ )
+  {
+    int zeroes = 0;
+
+    if ( strip )
+      buf[n++] = 'z';
+
+    for ( u = 0 ; u < w ; u++ )
+    {
+      int v = 0;
+
+      for ( k = 0 ; k < 5 && 5 * strip + k < h ; k++ )
+      {
+        // Cell (u, 5 * strip + k) of the transformed form
+        int a = u, b = 5 * strip + k;
+
+        if ( sym & 4 )
+        {
+          a = b;
+          b = u;
+        }
+
+        if ( sym & 1 ) a = f->w - 1 - a;
+        if ( sym & 2 ) b = f->h - 1 - b;
+
+        v |= (int) (f->rows[b] >> a & 1) << k;
+      }
+
+      if ( !v )
+      {
+        zeroes++;
+        continue;
+      }
+
+      for ( ; zeroes > 39 ; zeroes -= 39 )
+      {
+        buf[n++] = 'y';
+        buf[n++] = chars[35];
+      }
+
+      if ( zeroes == 1 )
+        buf[n++] = '0';
+      else if ( zeroes == 2 )
+        buf[n++] = 'w';
+      else if ( zeroes == 3 )
+        buf[n++] = 'x';
+      else if ( zeroes > 3 )
+      {
+        buf[n++] = 'y';
+        buf[n++] = chars[zeroes - 4];
+      }
+
+      zeroes = 0;
+      buf[n++] = chars[v];
+    }
+  }
+
+  buf[n] = '\0';
+}
+
+// FNV-1a
+uint64_t seed_hash(const char *seed)
+{
+  uint64_t h = 0xCBF29CE484222325ull;
+
+  for ( ; *seed ; seed++ )
+    h = (h ^ (unsigned char) *seed) * 0x100000001B3ull;
+
+  return h;
+}
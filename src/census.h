@@ -0,0 +1,60 @@
+#ifndef CENSUS_H
+#define CENSUS_H
+
+#include <stdio.h>
+#include "definitions.h"
+#include "hashtbl.h"
+#include "rulekernel.h"
+
+/* Soup search: seeded random soups are evolved until they settle, then
+ * their ash is separated into objects, which are named and tallied.
+ *
+ * The soups are evolved 64 at a time in the bit lanes (see soup.h). Those
+ * which leave the grid or do not settle there go on in hashlife, in the
+ * hashtable of the thread, until their population is periodic.
+ *
+ * The ash is split into the groups of cells within distance 2 of each
+ * other. Each object is named by its apgcode: xs<population> (still
+ * life), xp<period> (oscillator) or xq<period> (spaceship), followed by
+ * its smallest extended Wechsler code over its phases and the 8
+ * symmetries. Objects which are too large or not periodic are named
+ * ov_s<population> and zz_s<population>. */
+
+#define CENSUS_SIDE 16         // soups of 16x16 cells
+#define CENSUS_PERIOD_MAX 30   // of the objects
+#define CENSUS_NAME_MAX 512
+
+typedef struct Census Census;
+
+Census *census_new(void);
+void    census_free(Census *c);
+
+void census_add(Census *c, const char *name, long n);
+void census_merge(Census *dst, const Census *src);
+
+// Objects sorted by decreasing count
+void census_print(FILE *out, const Census *c);
+
+long census_soups(const Census *c);
+long census_objects(const Census *c);
+
+// Soups first to first + n - 1 of the seed, on threads threads,
+// each with its own hashtable
+void census_search(
+  Census *c,
+  rule r,
+  const char *seed,
+  long first,
+  long n,
+  int threads);
+
+// Name of the object made of the n cells (x[i], y[i]), into a buffer of
+// CENSUS_NAME_MAX chars
+void census_name(
+  const Rule_kernel *k,
+  const int *x,
+  const int *y,
+  int n,
+  char *name);
+
+#endif
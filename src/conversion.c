@@ -10,6 +10,8 @@
 #include "darray.h"
 #include "prgrph.h"
 #include "runlength.h"
+#include "celledit.h"
+#include "sparsemap.h"
 
 /*** Matrix to- conversion ***/
 struct Quad_repeat
@@ -447,6 +449,7 @@ int rle_take_two(
 /*** -to matrix conversion ***/
 
 void quad_to_matrix_(
+  Hashtbl *htbl,
   UMatrix p,
   int m_mmin,
   int m_nmin,
@@ -458,6 +461,7 @@ void quad_to_matrix_(
   Quad *q);
 
 UMatrix quad_to_matrix(
+  Hashtbl *htbl,
   BigInt *mmin,
   BigInt *nmin,
   int mlen,
@@ -490,7 +494,7 @@ UMatrix quad_to_matrix(
     }
   }
 
-  quad_to_matrix_(p,
+  quad_to_matrix_(htbl, p,
     0, 0,
     mmin, nmin,
     mlen, nlen,
@@ -500,6 +504,7 @@ UMatrix quad_to_matrix(
 }
 
 void quad_to_matrix_(
+  Hashtbl *htbl,
   UMatrix p,
   int m_mmin,
   int m_nmin,
@@ -512,6 +517,18 @@ void quad_to_matrix_(
 {
   if ( mlen <= 0 || nlen <= 0 )
     return;
+  else if ( q->flags & QUAD_EMPTY )
+  {
+    int i, j;
+    for ( i = 0 ; i < mlen ; i++ )
+      for ( j = 0 ; j < nlen ; j++ )
+      {
+        if ( height > 0 )
+          p.um_bi[m_mmin+i][m_nmin+j] = bi_zero_const;
+        else
+          p.um_char[m_mmin+i][m_nmin+j] = DEAD;
+      }
+  }
   else if ( q->depth <= height - 1 )
   {
     int i, j;
@@ -519,7 +536,7 @@ void quad_to_matrix_(
       for ( j = 0 ; j < nlen ; j++ )
       {
         p.um_bi[m_mmin+i][m_nmin+j] =
-          i || j ? bi_zero_const : cell_count(q);
+          i || j ? bi_zero_const : cell_count(htbl, q);
       }
   }
   else if ( q->depth == 0 )
@@ -564,7 +581,7 @@ void quad_to_matrix_(
     {
       const int x = i >> 1, y = i & 1;
 
-      quad_to_matrix_(p,
+      quad_to_matrix_(htbl, p,
                       m_mmin_[x], m_nmin_[y],
                       mmin_[x], nmin_[y],
                       mlen_[x], nlen_[y],
@@ -615,3 +632,137 @@ void free_um_bi(UMatrix um, int m)
     free(um.um_bi[i]);
   free(um.um_char);
 }
+
+/*** Sparse map conversions ***/
+
+struct Smap_cell
+{
+  int i, j;
+};
+
+void quad_to_cells(Hashtbl *htbl, Quad *q, int i, int j, Darray *cells);
+int  cmp_smap_cell(const void *a, const void *b);
+
+Smap *quad_to_smap(Hashtbl *htbl, Quad *q, int i, int j)
+{
+  Darray *da = da_new(sizeof(struct Smap_cell));
+  Smap *s = emptysmp();
+  int n, k, i_s = -1;
+
+  if ( !s )
+  {
+    perror("quad_to_smap()");
+    exit(1);
+  }
+
+  quad_to_cells(htbl, q, i, j, da);
+
+  struct Smap_cell *cells = da_unpack(da, &n);
+
+  // Row by row, so that lines and segments are appended
+  qsort(cells, n, sizeof(struct Smap_cell), cmp_smap_cell);
+
+  for ( k = 0 ; k < n ; k++ )
+  {
+    if ( k == 0 || cells[k].i != cells[k-1].i )
+      i_s = push_line(s, cells[k].i);
+
+    if ( i_s == -1 || !add_point(s, i_s, cells[k].j) )
+    {
+      perror("quad_to_smap()");
+      exit(1);
+    }
+  }
+
+  free(cells);
+
+  return s;
+}
+
+Quad *smap_to_quad(Hashtbl *htbl, const Smap *s, int e_min, int *e)
+{
+  long n = smp_population(s), k = 0;
+  int i_min = 0, j_min = 0, i, j, b;
+
+  for ( i = 0 ; i < s->size ; i++ )
+  {
+    const Line *l = &s->list[i];
+
+    if ( l->i < i_min )
+      i_min = l->i;
+
+    if ( l->size > 0 && 64 * l->seg[0].j < j_min )
+      j_min = 64 * l->seg[0].j;
+  }
+
+  for ( *e = e_min ; (1 << *e) < -i_min || (1 << *e) < -j_min ; (*e)++ );
+
+  const int64_t off = (int64_t) 1 << *e;
+
+  Cell_edit *edits = malloc((n ? n : 1) * sizeof(Cell_edit));
+
+  if ( !edits )
+  {
+    perror("smap_to_quad()");
+    exit(1);
+  }
+
+  for ( i = 0 ; i < s->size ; i++ )
+  {
+    const Line *l = &s->list[i];
+
+    for ( j = 0 ; j < l->size ; j++ )
+      for ( b = 0 ; b < 64 ; b++ )
+        if ( l->seg[j].bits >> b & 1 )
+        {
+          edits[k].x = off + 64 * (int64_t) l->seg[j].j + b;
+          edits[k].y = off + l->i;
+          edits[k].state = 1;
+          k++;
+        }
+  }
+
+  // Large enough to hold the origin
+  Quad *q = quad_edit(htbl, dead_space(htbl, *e), edits, n);
+
+  free(edits);
+
+  return q;
+}
+
+// Live cells of q, its top-left corner at row i and column j
+void quad_to_cells(Hashtbl *htbl, Quad *q, int i, int j, Darray *cells)
+{
+  int k;
+
+  if ( q == dead_space(htbl, q->depth) )
+    return;
+
+  if ( q->depth == 0 )
+  {
+    for ( k = 0 ; k < 4 ; k++ )
+      if ( q->node.l.map[k] )
+      {
+        struct Smap_cell cell = {i + (k >> 1), j + (k & 1)};
+        da_push(cells, &cell);
+      }
+
+    return;
+  }
+
+  const int half = 1 << q->depth;
+
+  for ( k = 0 ; k < 4 ; k++ )
+    quad_to_cells(htbl, q->node.n.sub[k],
+      i + (k >> 1) * half, j + (k & 1) * half, cells);
+}
+
+int cmp_smap_cell(const void *a, const void *b)
+{
+  const struct Smap_cell *ca = a, *cb = b;
+
+  if ( ca->i != cb->i )
+    return ca->i < cb->i ? -1 : 1;
+  else
+    return (ca->j > cb->j) - (ca->j < cb->j);
+}
@@ -5,6 +5,7 @@
 #include "prgrph.h"
 #include "runlength.h"
 #include "hashtbl.h"
+#include "sparsemap.h"
 
 typedef union UMatrix
 {
@@ -19,6 +20,7 @@ Quad *rle_to_quad(Hashtbl *htbl, Rle *rle);
 
 // Draw the prgrph described by q at the specified location
 UMatrix quad_to_matrix(
+  Hashtbl *htbl,
   BigInt *mmin,
   BigInt *nmin,
   int mlen,
@@ -32,6 +34,13 @@ Prgrph bi_mat_to_prgrph(
   int n,
   int height);
 
+// Live cells of q, the top-left corner of q at row i and column j
+Smap *quad_to_smap(Hashtbl *htbl, Quad *q, int i, int j);
+// Tree of the cells of s, the origin of s at (2^e, 2^e) in the tree,
+// with e >= e_min the smallest exponent leaving no cell at negative
+// coordinates
+Quad *smap_to_quad(Hashtbl *htbl, const Smap *s, int e_min, int *e);
+
 void free_um_char(UMatrix um, int m);
 void free_um_bi(UMatrix um, int m);
 
@@ -0,0 +1,761 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "escape.h"
+#include "bigint.h"
+#include "hashtbl.h"
+#include "quadops.h"
+#include "celledit.h"
+
+#define ESCAPE_CELLS 32   // of a phase of a ship
+#define ESCAPE_EXTENT 8   // of the ships, in the metric of any direction
+#define ESCAPE_COLLECT 64 // cells looked at behind the front
+#define ESCAPE_SHIPS 32   // orientations in the catalog
+#define ESCAPE_BOX 16     // grid where the catalog is evolved
+#define ESCAPE_MEMO (1 << 14) // fronts of the nodes
+
+typedef struct Point
+{
+  int64_t x, y;
+} Point;
+
+// Cells sorted by rows, the top-left corner of the bounding box at (0, 0)
+typedef struct Shape
+{
+  int n, w, h;
+  int x[ESCAPE_CELLS], y[ESCAPE_CELLS];
+  int ox, oy; // corner, from that of phase 0 p generations before
+} Shape;
+
+// A ship in one orientation
+typedef struct Ship
+{
+  const char *name;
+  int         vx, vy; // displacement over a period
+  Shape       phase[ESCAPE_PERIOD];
+} Ship;
+
+typedef struct Stream
+{
+  const Ship *ship;
+  int64_t     x, y;    // corner of the leading ship at phase 0,
+  int64_t     t;       // at generation t
+  long        count;
+  long        spacing; // generations between two ships
+} Stream;
+
+// Front of a node in a direction, from its corner
+typedef struct Front_entry
+{
+  Quad   *q;
+  int     dir;
+  int64_t top;
+} Front_entry;
+
+struct Escape
+{
+  Hashtbl     *htbl;
+  int          n_ships;
+  Ship         ships[ESCAPE_SHIPS];
+  int          len, size;
+  Stream      *streams;
+  Front_entry *memo; // cleared by each escape_prune()
+};
+
+typedef char Grid[ESCAPE_BOX][ESCAPE_BOX];
+
+void  catalog_add(Escape *es, const char *name, const char *rows[], int n);
+void  grid_step(Grid g);
+void  grid_shape(Grid g, Shape *s, int *x, int *y);
+int   shape_equal(const Shape *a, const Shape *b);
+
+const Ship *front_ship(Escape *es, Quad *root, int dx, int dy, int64_t gap,
+                       Point *cells, int *n, int *phase);
+int   match(const Shape *s, Point *cells, int n);
+int   cmp_point(const void *a, const void *b);
+int   is_dead(Hashtbl *htbl, Quad *q);
+int   front(Escape *es, Quad *q, int dx, int dy, int64_t *top);
+int   collect(Escape *es, Quad *q, int64_t x, int64_t y, int dx, int dy,
+              int64_t min, Point *cells, int *n);
+
+void  record(Escape *es, const Ship *sh, int p, int64_t x, int64_t y,
+             int64_t gen);
+Quad *restore_stream(Escape *es, Quad *q, const Stream *st, int r, int m,
+                     int64_t gen, uint64_t o);
+Quad *paste_at(Hashtbl *htbl, Quad *dst, Quad *src, uint64_t x, uint64_t y);
+
+/**************************************************/
+
+Escape *escape_new(Hashtbl *htbl)
+{
+  const rule conway = 6152; // parse_rule("b3/s23");
+
+  if ( hashtbl_rule(htbl) != conway )
+    return NULL;
+
+  Escape *es = malloc(sizeof(Escape));
+
+  if ( !es )
+  {
+    perror("escape_new()");
+    exit(1);
+  }
+
+  es->htbl    = htbl;
+  es->n_ships = 0;
+  es->len     = 0;
+  es->size    = 0;
+  es->streams = NULL;
+  es->memo    = calloc(ESCAPE_MEMO, sizeof(Front_entry));
+
+  if ( !es->memo )
+  {
+    perror("escape_new()");
+    exit(1);
+  }
+
+  const char *glider[] = {".o.", "..o", "ooo"},
+             *lwss[]   = {".o..o", "o....", "o...o", "oooo."},
+             *mwss[]   = {"...o..", ".o...o", "o.....", "o....o", "ooooo."},
+             *hwss[]   = {"...oo..", ".o....o", "o......", "o.....o",
+                          "oooooo."};
+
+  catalog_add(es, "glider", glider, 3);
+  catalog_add(es, "LWSS", lwss, 4);
+  catalog_add(es, "MWSS", mwss, 5);
+  catalog_add(es, "HWSS", hwss, 5);
+
+  return es;
+}
+
+void escape_free(Escape *es)
+{
+  free(es->streams);
+  free(es->memo);
+  free(es);
+}
+
+void escape_clear(Escape *es)
+{
+  es->len = 0;
+}
+
+Quad *escape_prune(
+  Escape *es,
+  Quad *root,
+  const BigInt *offset,
+  const BigInt *gen,
+  int t)
+{
+  // The first generations are skipped, so that the phase 0 of a removed
+  // ship is at a positive generation
+  if ( root->depth > ESCAPE_DEPTH_MAX || t > ESCAPE_DEPTH_MAX ||
+       bi_log2(offset) > ESCAPE_DEPTH_MAX ||
+       bi_log2(gen) > ESCAPE_DEPTH_MAX || bi_log2(gen) < 3 )
+    return root;
+
+  const int64_t o = bi_to_u64(offset), g = bi_to_u64(gen);
+  int dx, dy;
+
+  // The nodes may have been moved by a compaction
+  memset(es->memo, 0, ESCAPE_MEMO * sizeof(Front_entry));
+
+  for ( dy = -1 ; dy <= 1 ; dy++ )
+    for ( dx = -1 ; dx <= 1 ; dx++ )
+    {
+      Point cells[ESCAPE_CELLS];
+      const Ship *sh;
+      int n, p, k = 0;
+
+      if ( !dx && !dy )
+        continue;
+
+      // Light moves by 1 in x or y, by 2 in x +/- y per generation
+      const int64_t gap = ESCAPE_GAP + ((int64_t) (dx && dy ? 2 : 1) << t);
+
+      while ( k++ < ESCAPE_PRUNE_MAX &&
+              (sh = front_ship(es, root, dx, dy, gap, cells, &n, &p)) )
+      {
+        Cell_edit edits[ESCAPE_CELLS];
+        int64_t x = cells[0].x, y = cells[0].y;
+        int i;
+
+        for ( i = 0 ; i < n ; i++ )
+        {
+          edits[i].x = cells[i].x;
+          edits[i].y = cells[i].y;
+          edits[i].state = 0;
+
+          if ( cells[i].x < x )
+            x = cells[i].x;
+          if ( cells[i].y < y )
+            y = cells[i].y;
+        }
+
+        root = quad_edit(es->htbl, root, edits, n);
+        record(es, sh, p, x - o, y - o, g);
+      }
+    }
+
+  return root;
+}
+
+Quad *escape_restore(
+  Escape *es,
+  Quad *root,
+  const BigInt *offset,
+  const BigInt *gen,
+  int e_min,
+  int *e)
+{
+  const int64_t g = bi_to_u64(gen), o = bi_to_u64(offset);
+
+  // Bound on the distance of the cells to the original top-left corner
+  int64_t lim = o + ((int64_t) 2 << root->depth);
+  int i;
+
+  for ( i = 0 ; i < es->len ; i++ )
+  {
+    const Stream *st = &es->streams[i];
+    const int64_t d = (g - st->t) / ESCAPE_PERIOD + 1,
+                  x = llabs(st->x) + d * abs(st->ship->vx),
+                  y = llabs(st->y) + d * abs(st->ship->vy);
+
+    if ( lim < x + ESCAPE_BOX )
+      lim = x + ESCAPE_BOX;
+    if ( lim < y + ESCAPE_BOX )
+      lim = y + ESCAPE_BOX;
+  }
+
+  // The streams are pasted as trees up to twice as wide as themselves
+  int E = e_min;
+
+  while ( E < 62 && ((int64_t) 1 << E) <= 8 * lim )
+    E++;
+
+  if ( E == 62 )
+  {
+    fprintf(stderr, "escape_restore(): too far away\n");
+    exit(1);
+  }
+
+  const uint64_t O = (uint64_t) 1 << E;
+  BigInt *x = bi_from_u64(O - o);
+
+  Quad *q = quad_translate(es->htbl, root, x, x, E + 1);
+
+  bi_free(x);
+
+  for ( i = 0 ; i < es->len ; i++ )
+  {
+    const Stream *st = &es->streams[i];
+
+    // The ships r, r + m, r + 2m... are at the same phase
+    int m = 1, r;
+
+    while ( m * st->spacing % ESCAPE_PERIOD )
+      m++;
+
+    for ( r = 0 ; r < m && r < st->count ; r++ )
+      q = restore_stream(es, q, st, r, m, g, O);
+  }
+
+  *e = E;
+
+  return q;
+}
+
+long escape_ships(const Escape *es)
+{
+  long n = 0;
+  int i;
+
+  for ( i = 0 ; i < es->len ; i++ )
+    n += es->streams[i].count;
+
+  return n;
+}
+
+void escape_print(FILE *out, const Escape *es)
+{
+  int i;
+
+  for ( i = 0 ; i < es->len ; i++ )
+  {
+    const Stream *st = &es->streams[i];
+
+    fprintf(out, "%s at (%lld, %lld) phase 0 at generation %lld, "
+                 "velocity (%d, %d)/%d: %ld ship(s)",
+            st->ship->name, (long long) st->x, (long long) st->y,
+            (long long) st->t, st->ship->vx, st->ship->vy, ESCAPE_PERIOD,
+            st->count);
+
+    if ( st->count > 1 )
+      fprintf(out, " every %ld generations", st->spacing);
+
+    fprintf(out, "\n");
+  }
+}
+
+/*** Auxiliary functions ***/
+
+// The 8 orientations of the ship, evolved over a period, but those which
+// are another phase of an orientation already in the catalog
+void catalog_add(Escape *es, const char *name, const char *rows[], int n)
+{
+  int s;
+
+  for ( s = 0 ; s < 8 ; s++ )
+  {
+    Grid g;
+    Ship sh;
+    int i, j, p, x0 = 0, y0 = 0;
+
+    memset(g, 0, sizeof(Grid));
+
+    for ( i = 0 ; i < n ; i++ )
+      for ( j = 0 ; rows[i][j] ; j++ )
+        if ( rows[i][j] == 'o' )
+        {
+          int x = s & 4 ? i : j, y = s & 4 ? j : i;
+
+          if ( s & 2 )
+            y = 7 - y;
+          if ( s & 1 )
+            x = 7 - x;
+
+          g[4 + y][4 + x] = 1;
+        }
+
+    sh.name = name;
+
+    for ( p = 0 ; p <= ESCAPE_PERIOD ; p++ )
+    {
+      Shape f;
+      int x, y;
+
+      grid_shape(g, &f, &x, &y);
+
+      if ( p == 0 )
+      {
+        x0 = x;
+        y0 = y;
+      }
+
+      f.ox = x - x0;
+      f.oy = y - y0;
+
+      if ( p < ESCAPE_PERIOD )
+        sh.phase[p] = f;
+      else
+      {
+        sh.vx = f.ox;
+        sh.vy = f.oy;
+      }
+
+      grid_step(g);
+    }
+
+    int dup = 0;
+
+    for ( i = 0 ; i < es->n_ships ; i++ )
+      for ( p = 0 ; p < ESCAPE_PERIOD ; p++ )
+        if ( es->ships[i].name == name &&
+             shape_equal(&es->ships[i].phase[p], &sh.phase[0]) )
+          dup = 1;
+
+    if ( !dup )
+      es->ships[es->n_ships++] = sh;
+  }
+}
+
+void grid_step(Grid g)
+{
+  Grid h;
+  int i, j, k, l;
+
+  for ( i = 0 ; i < ESCAPE_BOX ; i++ )
+    for ( j = 0 ; j < ESCAPE_BOX ; j++ )
+    {
+      int c = 0;
+
+      for ( k = i - 1 ; k <= i + 1 ; k++ )
+        for ( l = j - 1 ; l <= j + 1 ; l++ )
+          if ( k >= 0 && k < ESCAPE_BOX && l >= 0 && l < ESCAPE_BOX &&
+               (k != i || l != j) )
+            c += g[k][l];
+
+      h[i][j] = c == 3 || (c == 2 && g[i][j]);
+    }
+
+  memcpy(g, h, sizeof(Grid));
+}
+
+// (x, y): top-left corner of the bounding box in the grid
+void grid_shape(Grid g, Shape *s, int *x, int *y)
+{
+  int i, j, x1 = 0, y1 = 0;
+
+  *x = ESCAPE_BOX;
+  *y = ESCAPE_BOX;
+  s->n = 0;
+
+  for ( i = 0 ; i < ESCAPE_BOX ; i++ )
+    for ( j = 0 ; j < ESCAPE_BOX ; j++ )
+      if ( g[i][j] )
+      {
+        s->x[s->n] = j;
+        s->y[s->n++] = i;
+
+        if ( j < *x )
+          *x = j;
+        if ( i < *y )
+          *y = i;
+        if ( j > x1 )
+          x1 = j;
+        if ( i > y1 )
+          y1 = i;
+      }
+
+  for ( i = 0 ; i < s->n ; i++ )
+  {
+    s->x[i] -= *x;
+    s->y[i] -= *y;
+  }
+
+  s->w = x1 - *x + 1;
+  s->h = y1 - *y + 1;
+}
+
+int shape_equal(const Shape *a, const Shape *b)
+{
+  int i;
+
+  if ( a->n != b->n )
+    return 0;
+
+  for ( i = 0 ; i < a->n ; i++ )
+    if ( a->x[i] != b->x[i] || a->y[i] != b->y[i] )
+      return 0;
+
+  return 1;
+}
+
+// The ship furthest in the direction (dx, dy), if the other cells are at
+// least gap behind it: its n cells in the root, and its phase
+const Ship *front_ship(Escape *es, Quad *root, int dx, int dy, int64_t gap,
+                       Point *cells, int *n, int *phase)
+{
+  Point all[ESCAPE_COLLECT];
+  int64_t top;
+  int m = 0, i, j, p;
+
+  if ( !front(es, root, dx, dy, &top) ||
+       !collect(es, root, 0, 0, dx, dy,
+                top - ESCAPE_EXTENT - gap, all, &m) )
+    return NULL;
+
+  for ( i = 0 ; i < es->n_ships ; i++ )
+  {
+    const Ship *sh = &es->ships[i];
+
+    if ( (sh->vx > 0) - (sh->vx < 0) != dx ||
+         (sh->vy > 0) - (sh->vy < 0) != dy )
+      continue;
+
+    for ( p = 0 ; p < ESCAPE_PERIOD ; p++ )
+    {
+      const Shape *s = &sh->phase[p];
+      int64_t lo = 0, hi = 0;
+
+      // Extent of the phase in the metric of the direction
+      for ( j = 0 ; j < s->n ; j++ )
+      {
+        const int64_t f = dx * s->x[j] + dy * s->y[j];
+
+        if ( j == 0 || f < lo )
+          lo = f;
+        if ( j == 0 || f > hi )
+          hi = f;
+      }
+
+      // The ship, then nothing less than gap behind it
+      const int64_t back = top - (hi - lo);
+      int k = 0, clear = 1;
+
+      for ( j = 0 ; j < m ; j++ )
+      {
+        const int64_t f = dx * all[j].x + dy * all[j].y;
+
+        if ( f >= back && k < ESCAPE_CELLS )
+          cells[k++] = all[j];
+        else if ( f >= back || f > back - gap )
+          clear = 0;
+      }
+
+      if ( clear && match(s, cells, k) )
+      {
+        *n = k;
+        *phase = p;
+
+        return sh;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+// Sorts the cells
+int match(const Shape *s, Point *cells, int n)
+{
+  int i;
+
+  if ( n != s->n )
+    return 0;
+
+  qsort(cells, n, sizeof(Point), cmp_point);
+
+  int64_t x = cells[0].x;
+
+  for ( i = 1 ; i < n ; i++ )
+    if ( cells[i].x < x )
+      x = cells[i].x;
+
+  for ( i = 0 ; i < n ; i++ )
+    if ( cells[i].x - x != s->x[i] || cells[i].y - cells[0].y != s->y[i] )
+      return 0;
+
+  return 1;
+}
+
+// By rows, then columns
+int cmp_point(const void *a, const void *b)
+{
+  const Point *p = a, *q = b;
+
+  if ( p->y != q->y )
+    return p->y < q->y ? -1 : 1;
+
+  return (p->x > q->x) - (p->x < q->x);
+}
+
+int is_dead(Hashtbl *htbl, Quad *q)
+{
+  if ( q->depth == 0 )
+    return !(q->node.l.map[0] | q->node.l.map[1] |
+             q->node.l.map[2] | q->node.l.map[3]);
+
+  return q == dead_space(htbl, q->depth);
+}
+
+// Greatest dx * x + dy * y over the live cells of q, from its corner,
+// 0 if there are none. Memoized, as the nodes of a stream are shared.
+int front(Escape *es, Quad *q, int dx, int dy, int64_t *top)
+{
+  const int64_t half = (int64_t) 1 << q->depth;
+  const int dir = 3 * (dy + 1) + dx + 1;
+  int found = 0, i;
+
+  if ( is_dead(es->htbl, q) )
+    return 0;
+
+  Front_entry *e =
+    &es->memo[(((uintptr_t) q >> 4) * 9 + dir) & (ESCAPE_MEMO - 1)];
+
+  if ( e->q == q && e->dir == dir )
+  {
+    *top = e->top;
+    return 1;
+  }
+
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    const int64_t x_ = (i & 1) * half, y_ = (i >> 1) * half;
+    int64_t f;
+
+    if ( q->depth > 0 )
+    {
+      if ( !front(es, q->node.n.sub[i], dx, dy, &f) )
+        continue;
+    }
+    else if ( !q->node.l.map[i] )
+      continue;
+    else
+      f = 0;
+
+    f += dx * x_ + dy * y_;
+
+    if ( !found || f > *top )
+    {
+      *top = f;
+      found = 1;
+    }
+  }
+
+  e->q   = q;
+  e->dir = dir;
+  e->top = *top;
+
+  return 1;
+}
+
+// The live cells of q, of corner (x, y), where dx * x + dy * y >= min,
+// 0 if there are more than ESCAPE_COLLECT
+int collect(Escape *es, Quad *q, int64_t x, int64_t y, int dx, int dy,
+            int64_t min, Point *cells, int *n)
+{
+  const int64_t half = (int64_t) 1 << q->depth;
+  int64_t top;
+  int i;
+
+  if ( !front(es, q, dx, dy, &top) || dx * x + dy * y + top < min )
+    return 1;
+
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    const int64_t x_ = x + (i & 1) * half, y_ = y + (i >> 1) * half;
+
+    if ( q->depth > 0 )
+    {
+      if ( !collect(es, q->node.n.sub[i], x_, y_, dx, dy, min, cells, n) )
+        return 0;
+    }
+    else if ( q->node.l.map[i] && dx * x_ + dy * y_ >= min )
+    {
+      if ( *n == ESCAPE_COLLECT )
+        return 0;
+
+      cells[*n].x = x_;
+      cells[(*n)++].y = y_;
+    }
+  }
+
+  return 1;
+}
+
+// The ship of corner (x, y) at phase p of generation gen, in the original
+// frame, extends a stream if it follows its last ship on its track
+void record(Escape *es, const Ship *sh, int p, int64_t x, int64_t y,
+            int64_t gen)
+{
+  const int64_t ax = x - sh->phase[p].ox, ay = y - sh->phase[p].oy,
+                t = gen - p;
+  int i;
+
+  for ( i = 0 ; i < es->len ; i++ )
+  {
+    Stream *st = &es->streams[i];
+
+    if ( st->ship != sh )
+      continue;
+
+    // On the track, j periods after the leading ship
+    const int64_t j = sh->vx ? (ax - st->x) / sh->vx : (ay - st->y) / sh->vy;
+
+    if ( ax - st->x != j * sh->vx || ay - st->y != j * sh->vy )
+      continue;
+
+    const int64_t delay = t - st->t - ESCAPE_PERIOD * j;
+
+    if ( delay > 0 && (st->count == 1 || delay == st->count * st->spacing) )
+    {
+      if ( st->count == 1 )
+        st->spacing = delay;
+
+      st->count++;
+
+      return;
+    }
+  }
+
+  if ( es->len == es->size )
+  {
+    es->size = es->size ? 2 * es->size : 8;
+    es->streams = realloc(es->streams, es->size * sizeof(Stream));
+
+    if ( !es->streams )
+    {
+      perror("record()");
+      exit(1);
+    }
+  }
+
+  Stream st = {
+    .ship    = sh,
+    .x       = ax,
+    .y       = ay,
+    .t       = t,
+    .count   = 1,
+    .spacing = 0,
+  };
+
+  es->streams[es->len++] = st;
+}
+
+// Pastes the ships r, r + m, r + 2m... of the stream into q, where the
+// original top-left corner is at (o, o). They are the same phase of the
+// ship, each translated by w from the previous one: their tree is built
+// by doubling, towards the bottom-right, then flipped to the direction
+// of w.
+Quad *restore_stream(Escape *es, Quad *q, const Stream *st, int r, int m,
+                     int64_t gen, uint64_t o)
+{
+  Hashtbl *htbl = es->htbl;
+  const Ship *sh = st->ship;
+  // Negative when the ships were removed together, before the ship r
+  // reached the position of the leading one
+  const int64_t tau = gen - st->t - r * st->spacing,
+                per = (tau - (tau < 0 ? ESCAPE_PERIOD - 1 : 0)) / ESCAPE_PERIOD;
+  const Shape *s = &sh->phase[tau - per * ESCAPE_PERIOD];
+  const int64_t px = st->x + per * sh->vx + s->ox,
+                py = st->y + per * sh->vy + s->oy,
+                back = m * st->spacing / ESCAPE_PERIOD,
+                wx = -back * sh->vx, wy = -back * sh->vy;
+  const int fx = wx < 0, fy = wy < 0;
+
+  Cell_edit edits[ESCAPE_CELLS];
+  int i;
+
+  for ( i = 0 ; i < s->n ; i++ )
+  {
+    edits[i].x = fx ? s->w - 1 - s->x[i] : s->x[i];
+    edits[i].y = fy ? s->h - 1 - s->y[i] : s->y[i];
+    edits[i].state = 1;
+  }
+
+  Quad *b = quad_edit(htbl, dead_space(htbl, 2), edits, s->n), *c = NULL;
+  const uint64_t sx = llabs(wx), sy = llabs(wy);
+  uint64_t k = (st->count - r + m - 1) / m, done = 0, step = 1;
+
+  for ( ; k ; k >>= 1, step <<= 1 )
+  {
+    if ( k & 1 )
+    {
+      c = c ? paste_at(htbl, c, b, done * sx, done * sy) : b;
+      done += step;
+    }
+
+    if ( k > 1 )
+      b = paste_at(htbl, b, b, step * sx, step * sy);
+  }
+
+  const int64_t side = (int64_t) 2 << c->depth;
+
+  c = quad_sym(htbl, c, (fy ? 2 : 0) | (fx ? 1 : 0));
+
+  return paste_at(htbl, q, c, o + px - (fx ? side - s->w : 0),
+                              o + py - (fy ? side - s->h : 0));
+}
+
+Quad *paste_at(Hashtbl *htbl, Quad *dst, Quad *src, uint64_t x, uint64_t y)
+{
+  BigInt *bx = bi_from_u64(x), *by = bi_from_u64(y);
+
+  Quad *q = quad_paste(htbl, dst, src, bx, by);
+
+  bi_free(bx);
+  bi_free(by);
+
+  return q;
+}
@@ -0,0 +1,63 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include <stdio.h>
+#include "bigint.h"
+#include "hashtbl.h"
+
+/* Pruning of the spaceships escaping a pattern (Conway's rule only).
+ *
+ * For each of the 8 directions, the cells furthest in that direction are
+ * matched against the phases of the glider and of the light, middle and
+ * heavy weight spaceships moving that way. A ship is removed when all the
+ * other cells are at least ESCAPE_GAP behind it (by x, y or x +/- y),
+ * plus the light cone of the coming step: they cannot expand faster than
+ * the ship moves (c/2 orthogonally, c/4 diagonally), so they never reach
+ * it, and nothing of the step depends on it. As the gaps of a stream are
+ * short, it is only pruned before short steps, at most ESCAPE_PRUNE_MAX
+ * ships per direction at a time.
+ *
+ * The removed ships are kept in a side list of streams: the ships of a
+ * stream follow the same track, each a fixed number of generations behind
+ * the previous one, as the output of a gun. */
+
+#define ESCAPE_GAP 10
+#define ESCAPE_PRUNE_MAX 64
+#define ESCAPE_PERIOD 4     // of all the ships of the catalog
+#define ESCAPE_DEPTH_MAX 60 // coordinates and generations on 64 bits
+
+typedef struct Escape Escape;
+
+// NULL if the rule of the table is not Conway's
+Escape *escape_new(Hashtbl *htbl);
+void    escape_free(Escape *es);
+
+// Forget the removed ships
+void    escape_clear(Escape *es);
+
+// Remove the escaping ships of root, at generation gen, where the original
+// top-left corner is at (offset, offset), before a step of 2^t generations
+Quad   *escape_prune(
+  Escape *es,
+  Quad *root,
+  const BigInt *offset,
+  const BigInt *gen,
+  int t);
+
+// root with the removed ships at generation gen, in the frame of destiny():
+// the original top-left corner is at (2^e, 2^e), with e >= e_min
+Quad   *escape_restore(
+  Escape *es,
+  Quad *root,
+  const BigInt *offset,
+  const BigInt *gen,
+  int e_min,
+  int *e);
+
+long    escape_ships(const Escape *es);
+
+// One line per stream: ship, position and generation of its phase 0,
+// velocity, number of ships and generations between them
+void    escape_print(FILE *out, const Escape *es);
+
+#endif
@@ -3,12 +3,22 @@
 #include "bigint.h"
 #include "hashtbl.h"
 #include "hashlife.h"
+#include "quadops.h"
+#include "progress.h"
+#include "trace.h"
+#include "perfctr.h"
 
 #define DEBUG
 
-Quad *center(Hashtbl *htbl, Quad *quad[4], int d);
+// Smaller nodes are not looked up through their images: their misses
+// cost less than the lookups
+#define SYM_DEPTH_MIN 4
 
-Quad *expand(Hashtbl *htbl, Quad *q, int d);
+void  fates(Hashtbl *htbl, Quad *q[], int n, int t);
+int   inert(Quad *q, int t);
+Quad *inert_fate(Hashtbl *htbl, Quad *q);
+int   overlap_flags(Quad *ov[9]);
+Quad *sym_fate(Hashtbl *htbl, Quad *q, int t);
 
 /**************************************************/
 
@@ -17,25 +27,68 @@ Quad *expand(Hashtbl *htbl, Quad *q, int d);
 
 Quad *fate(Hashtbl *htbl, Quad *q, int t)
 {
+  Stats *stats = hashtbl_stats(htbl);
+
+  // Depth 1 nodes are not memoized, but looked up in the rule table
+  if ( q->depth == 1 )
+  {
+    stats->fate_hits++;
+    STATS_DT(stats->fate_hits_dt, 1, 0);
+    return step_d1(htbl, q);
+  }
+
   Quad *f = map_assoc(q->node.n.next, t);
 
+  // Inert nodes are not memoized, their center is their fate
+  if ( f == NULL && inert(q, t) )
+  {
+    stats->fate_inert++;
+    return inert_fate(htbl, q);
+  }
+
+  Trace *tr = hashtbl_trace(htbl);
+  const int hit = f != NULL;
+  const double start = tr ? trace_enter(tr, q->depth) : -1;
+
+  Perfctr *pc = hashtbl_perfctr(htbl);
+  const int window = pc && perfctr_window_begin(pc, q->depth);
+
+  // The 8x8 squares are evolved at once by the compiled rule
+  if ( f == NULL && q->depth == 2 )
+  {
+    stats->fate_misses++;
+    STATS_DT(stats->fate_misses_dt, 2, t);
+
+    step_d2(htbl, &q, 1, t, &f);
+    q->node.n.next = map_add(htbl, q->node.n.next, t, f);
+  }
+  // The fate of an image of q, brought back
+  else if ( f == NULL && hashtbl_symmetry(htbl) &&
+            q->depth >= SYM_DEPTH_MIN && (f = sym_fate(htbl, q, t)) )
+  {
+    stats->fate_sym++;
+    q->node.n.next = map_add(htbl, q->node.n.next, t, f);
+  }
   // quad->depth > t
-  if ( f == NULL )
+  else if ( f == NULL )
   {
+    stats->fate_misses++;
+    STATS_DT(stats->fate_misses_dt, q->depth, t);
+
     /* qs is the array of depth d-2 subtrees
          00 01 02 03
          10 11 12 13
          20 21 22 23
          30 31 32 33
        q1 represents step 2^(d-1)
-         00 01 02
-         10 11 12
-         20 21 22 */
+         0 1 2
+         3 4 5
+         6 7 8 */
 
-    Quad *qs[4][4], *q1[3][3], *nxt[4],
-         **quad = q->node.n.sub;
+    Quad *qs[4][4], *q1[9], *ov[9], *nxt[4],
+         *keys[9][4], **quad = q->node.n.sub;
 
-    int i, j;
+    int i, j, k;
     
     const int d = q->depth;
     const int t_ = d == t + 1 ? t - 1 : t;
@@ -44,40 +97,188 @@ Quad *fate(Hashtbl *htbl, Quad *q, int t)
       for ( j = 0 ; j < 4 ; j++ )
         qs[i][j] = quad[(i & 2) + (j >> 1)]->node.n.sub[2 * (i & 1) + (j & 1)];
 
-    // we compute q1
+    // we compute q1, the nine lookups being batched
     for ( i = 0 ; i < 3 ; i++ )
       for ( j = 0 ; j < 3 ; j++ )
-      {
-        Quad *tmp[4];
-        int k;
-
         for ( k = 0 ; k < 4 ; k++ )
-          tmp[k] = qs[i + (k >> 1)][j + (k & 1)];
+          keys[3 * i + j][k] = qs[i + (k >> 1)][j + (k & 1)];
 
-        if ( d == t + 1 )
-          q1[i][j] = fate(htbl, cons_quad(htbl, tmp, d - 1), t - 1);
-        else
-          q1[i][j] = center(htbl, tmp, d - 2);
-      }
+    if ( d == t + 1 )
+    {
+      cons_quads(htbl, keys, 9, d - 1, q1);
 
-    // nxt=q->node.n.sub holds the quad tree pointer to step 2^d
-    for ( i = 0 ; i < 2 ; i++ )
-      for ( j = 0 ; j < 2 ; j++ )
-      {
-        Quad *tmp[4];
-        int k;
+      for ( i = 0 ; i < 9 ; i++ )
+        ov[i] = q1[i];
 
+      fates(htbl, q1, 9, t - 1);
+
+      // The nine overlapping nodes cover q, and are evolved by now
+      if ( !(q->flags & QUAD_KNOWN) )
+        q->flags |= overlap_flags(ov);
+    }
+    else if ( d > 2 )
+    {
+      // as center(), the keys are overwritten
+      for ( i = 0 ; i < 9 ; i++ )
         for ( k = 0 ; k < 4 ; k++ )
-          tmp[k] = q1[i + (k >> 1)][j + (k & 1)];
+          keys[i][k] = keys[i][k]->node.n.sub[3-k];
+
+      cons_quads(htbl, keys, 9, d - 2, q1);
+    }
+    else
+      for ( i = 0 ; i < 9 ; i++ )
+        q1[i] = center(htbl, keys[i], d - 2);
+
+    // The second half of the steps is skipped on inert nodes
+    if ( inert(q, t) )
+      f = inert_fate(htbl, q);
+    else
+    {
+      // nxt=q->node.n.sub holds the quad tree pointer to step 2^d
+      for ( i = 0 ; i < 2 ; i++ )
+        for ( j = 0 ; j < 2 ; j++ )
+          for ( k = 0 ; k < 4 ; k++ )
+            keys[2 * i + j][k] = q1[3 * (i + (k >> 1)) + j + (k & 1)];
+
+      cons_quads(htbl, keys, 4, d - 1, nxt);
+      fates(htbl, nxt, 4, t_);
+
+      f = cons_quad(htbl, nxt, d-1);
+
+      q->node.n.next = map_add(htbl, q->node.n.next, t, f);
+
+      // Registered for its images, under their common signature
+      if ( hashtbl_symmetry(htbl) && d >= SYM_DEPTH_MIN )
+        op_add_at(htbl, OP_SYM_FATE, NULL, NULL, QUAD_SIG(q), d << 8 | t, q);
+    }
+  }
+  else
+  {
+    stats->fate_hits++;
+    STATS_DT(stats->fate_hits_dt, q->depth, t);
+  }
+
+  if ( window )
+    perfctr_window_end(pc, q->depth);
+
+  if ( start >= 0 )
+    trace_exit(tr, start, q->depth, t, hit);
+
+  Progress *prog = hashtbl_progress(htbl);
+
+  if ( prog )
+    progress_fate(prog, htbl, q->depth, t);
+
+  return f;
+}
+
+// q[i] = fate(htbl, q[i], t) for n <= CONS_BATCH_MAX nodes of the same
+// depth. The misses of depth 2 are evolved together.
+void fates(Hashtbl *htbl, Quad *q[], int n, int t)
+{
+  int i;
 
-        Quad *tmpq = cons_quad(htbl, tmp, d - 1);
+  if ( q[0]->depth != 2 )
+  {
+    for ( i = 0 ; i < n ; i++ )
+      q[i] = fate(htbl, q[i], t);
+
+    return;
+  }
+
+  Stats *stats = hashtbl_stats(htbl);
+  Progress *prog = hashtbl_progress(htbl);
+  Quad *miss[CONS_BATCH_MAX], *res[CONS_BATCH_MAX];
+  int at[CONS_BATCH_MAX], m = 0;
 
-        nxt[2 * i + j] = fate(htbl, tmpq, t_);
-      }
+  for ( i = 0 ; i < n ; i++ )
+  {
+    Quad *f = map_assoc(q[i]->node.n.next, t);
+
+    if ( !f && inert(q[i], t) )
+    {
+      stats->fate_inert++;
+      q[i] = inert_fate(htbl, q[i]);
+    }
+    else if ( f )
+    {
+      stats->fate_hits++;
+      STATS_DT(stats->fate_hits_dt, 2, t);
+      q[i] = f;
+    }
+    else
+    {
+      stats->fate_misses++;
+      STATS_DT(stats->fate_misses_dt, 2, t);
+      miss[m] = q[i];
+      at[m++] = i;
+    }
+  }
 
-    f = cons_quad(htbl, nxt, d-1);
+  if ( m )
+    step_d2(htbl, miss, m, t, res);
+
+  for ( i = 0 ; i < m ; i++ )
+  {
+    // A node may be missing twice in the batch
+    if ( !map_assoc(miss[i]->node.n.next, t) )
+      miss[i]->node.n.next = map_add(htbl, miss[i]->node.n.next, t, res[i]);
 
-    q->node.n.next = map_add(q->node.n.next, t, f);
+    q[at[i]] = res[i];
+  }
+
+  if ( prog )
+    for ( i = 0 ; i < n ; i++ )
+      progress_fate(prog, htbl, 2, t);
+}
+
+// A stable node, or a period 2 node after an even number of steps
+int inert(Quad *q, int t)
+{
+  return (q->flags & QUAD_STABLE) || ((q->flags & QUAD_P2) && t >= 1);
+}
+
+Quad *inert_fate(Hashtbl *htbl, Quad *q)
+{
+  Quad *quad[4] = {
+    q->node.n.sub[0], q->node.n.sub[1],
+    q->node.n.sub[2], q->node.n.sub[3] };
+
+  return center(htbl, quad, q->depth - 1);
+}
+
+// The rule is isotropic: when q is the image of a node p by a symmetry,
+// the fate of q is the image of the fate of p. The last node evolved for
+// t with the signature of q is tried.
+Quad *sym_fate(Hashtbl *htbl, Quad *q, int t)
+{
+  Quad *p = op_find_at(htbl, OP_SYM_FATE, NULL, NULL,
+                       QUAD_SIG(q), q->depth << 8 | t), *f;
+  int s;
+
+  if ( !p || p == q || !(f = map_assoc(p->node.n.next, t)) )
+    return NULL;
+
+  for ( s = 1 ; s < QUAD_SYMS ; s++ )
+    if ( quad_sym_find(htbl, p, s) == q )
+      return quad_sym(htbl, f, s);
+
+  return NULL;
+}
+
+// The flags of a node are those shared by its nine overlapping subnodes
+// of half the side: each cell at distance 2 or more from the border of
+// the node is at that distance from the border of one of them
+int overlap_flags(Quad *ov[9])
+{
+  int i, f = QUAD_KNOWN | QUAD_EMPTY | QUAD_STABLE | QUAD_P2;
+
+  for ( i = 0 ; i < 9 ; i++ )
+  {
+    if ( !(ov[i]->flags & QUAD_KNOWN) )
+      return 0;
+
+    f &= ov[i]->flags;
   }
 
   return f;
@@ -126,11 +327,19 @@ Quad *destiny(
 
   q = cons_quad(htbl, quad_, ++d);
 
+  Progress *prog = hashtbl_progress(htbl);
+  const int bits = len;
+
   // Progress by powers of two
   for ( len-- ; len >= 0 ; len-- )
   {
     if ( bi_digit(bi, len) )
+    {
+      if ( prog )
+        progress_step(prog, htbl, len, bits, d + 1);
+
       q = fate(htbl, expand(htbl, q, d + 1), len);
+    }
   }
 
   return q;
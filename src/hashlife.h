@@ -11,4 +11,9 @@ Quad *destiny(
   const BigInt *bi,
   int *shift_e);
 
+Quad *expand(Hashtbl *htbl, Quad *q, int d);
+
+// Overwrites quad
+Quad *center(Hashtbl *htbl, Quad *quad[4], int d);
+
 #endif
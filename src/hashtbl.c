@@ -1,19 +1,45 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 #include "hashtbl.h"
+#include "rulelut.h"
+#include "rulekernel.h"
 
 typedef struct Quad_list Quad_list;
 typedef struct Quad_block Quad_block;
+typedef struct Op_entry Op_entry;
+typedef struct Map_block Map_block;
+typedef struct Byte_block Byte_block;
+
+typedef uint64_t (*Hash_fn)(Quad *key[4]);
 
 struct Hashtbl
 {
+  Hash_fn      hash_fn;
+  int          hash_kind;
   int          size;
   int          count;
+  rule         r;
+  const Rule_lut *lut;  // evolution of the depth 1 nodes
   int          dead_size;
   Quad       **dead_quad;
   Quad_block  *blocks;
   Quad_list  **tbl;
+  Map_block   *map_blocks;
+  Byte_block  *bytes;
+  BigInt      *small_count[5]; // populations of the leaves
+  Op_entry    *op_cache;
+  int          symmetry;  // see hashtbl_set_symmetry()
+  int          compaction; // see hashtbl_set_compaction()
+  int          live;       // nodes after the last compaction
+  Stats        stats;
+
+  struct Progress *progress;
+  struct Trace    *trace;
+  struct Perfctr  *perfctr;
 };
 
 struct Quad_list
@@ -33,64 +59,118 @@ struct Quad_block
 };
 
 typedef struct Quad_map Quad_map;
-typedef struct Map_block Map_block;
 
 struct Quad_map
 {
-  Map_block *qm_block;
   int        k;
   Quad      *v;
   Quad_map  *map_tail;
 };
 
+// Memo entries, owned by their hashtable
 struct Map_block
 {
-  int        m_block_alive;
   Map_block *next_m_block;
   int        m_block_len;
   Quad_map   m_block[BLOCK_MAX_LEN];
 };
 
+// Other data attached to the nodes (populations), owned by the hashtable.
+// Everything is released at once with the table.
+#define BYTE_BLOCK_LEN (1 << 20)
+
+struct Byte_block
+{
+  Byte_block *next_b_block;
+  size_t      b_block_len;
+  size_t      b_block_size;
+  char       *b_block;
+};
+
+// Results of operations on quad trees (see op_find()),
+// an entry is overwritten by the next result with the same hash
+#define OP_CACHE_SIZE (1 << 20)
+
+struct Op_entry
+{
+  int   op;
+  int   x, y;
+  Quad *a, *b;
+  Quad *v;
+};
+
 /*** Auxiliary functions ***/
 
 Quad_list *alloc_quad(Hashtbl *htbl);
-Quad_map  *alloc_map();
-void       map_block_compact();
-Map_block *map_block_compact_(Map_block *);
+Quad_map  *alloc_map(Hashtbl *htbl);
 
-// create depth 1 nodes. Part of hashlife_init() logic.
-void quad_d1(Hashtbl *htbl, Quad *quad[4], rule r); 
 
-int  hash(Quad*[4]);
+uint64_t hash_legacy(Quad *key[4]);
+uint64_t hash_mulxor(Quad *key[4]);
+uint64_t hash_wy(Quad *key[4]);
+uint64_t wymix(uint64_t a, uint64_t b);
+Quad    *cons_quad_at(Hashtbl *htbl, int h, Quad *quad[4], int d);
+void     flags_d2(const Rule_kernel *k, Quad *q[], int n, const uint64_t board[]);
+unsigned quad_sig(Quad *quad[4]);
+void     hashtbl_rehash(Hashtbl *htbl);
+
+int  op_hash(int op, Quad *a, Quad *b, int x, int y);
 Quad *hashtbl_find(Hashtbl *htbl, int h, Quad* key[4]);
 void hashtbl_add(Hashtbl *htbl, int h, Quad_list *elt);
-Quad *list_find(Quad* key[4], Quad_list *list);
+Quad *list_find(Quad* key[4], Quad_list *list, int *probes);
+
+Quad_block *new_block(void);
+Quad *gc_forward(Hashtbl *htbl, Quad *q, int *fresh);
+void  gc_scan(Hashtbl *htbl, Quad *q);
 
 void free_block(Quad_block *);
-void free_quad(Quad *);
-void free_map(Quad_map *); 
+void free_map_block(Map_block *);
+void free_byte_block(Byte_block *);
 
 /*** Constants and global elements ***/
 
+const struct
+{
+  const char *name;
+  Hash_fn     fn;
+} hash_family[HASH_KINDS] = {
+  {"legacy", hash_legacy},
+  {"mulxor", hash_mulxor},
+  {"wyhash", hash_wy},
+};
+
 const int init_size = 1 << 25; // size of hashtbl
 const int init_dead_size = 32;
 
+// A compaction clears all the chains, it is not worth it on fewer nodes
+const int compact_min = 1 << 20;
+
 /* The address of a leaf is a 4 digit binary number 0123
  * representing the 4 bit map
  * 0 1
  * 2 3 */
-const int  leaves_count = 16;
-Quad      *leaves       = NULL;
 
-Map_block *map_blocks = NULL;
+#define LEAF(i) \
+  { .depth = 0, .cell_count = NULL, \
+    .node.l.map = {(i) >> 3 & 1, (i) >> 2 & 1, (i) >> 1 & 1, (i) & 1} }
+
+// Shared by all the tables, never modified
+const Quad leaves[16] = {
+  LEAF(0),  LEAF(1),  LEAF(2),  LEAF(3),
+  LEAF(4),  LEAF(5),  LEAF(6),  LEAF(7),
+  LEAF(8),  LEAF(9),  LEAF(10), LEAF(11),
+  LEAF(12), LEAF(13), LEAF(14), LEAF(15)
+};
 
 /**************************************/
 
 Hashtbl *hashtbl_new(rule r)
 {
-  if (leaves == NULL) // Must initialize
-    hashlife_init();
+  return hashtbl_new_sized(r, init_size);
+}
 
+Hashtbl *hashtbl_new_sized(rule r, int size)
+{
   Hashtbl *htbl = malloc(sizeof(Hashtbl));
 
   if (htbl == NULL)
@@ -100,12 +180,29 @@ Hashtbl *hashtbl_new(rule r)
   }
 
   // Initialize fields
-  htbl->size      = init_size;
+  htbl->hash_kind = HASH_DEFAULT;
+  htbl->hash_fn   = hash_family[HASH_DEFAULT].fn;
+  htbl->size      = size;
   htbl->count     = 0;
+  htbl->r         = r;
+  htbl->lut       = rule_lut(r);
   htbl->dead_size = init_dead_size;
 
+  htbl->map_blocks = NULL;
+  htbl->bytes     = NULL;
+  htbl->op_cache  = NULL;
+  htbl->symmetry  = 0;
+  htbl->compaction = 0;
+  htbl->live      = 0;
+  htbl->progress  = NULL;
+  htbl->trace     = NULL;
+  htbl->perfctr   = NULL;
+
+  memset(&htbl->stats, 0, sizeof(Stats));
+
   htbl->blocks    = malloc(sizeof(Quad_block));
-  htbl->tbl       = malloc(init_size * sizeof(Quad_list*));
+  // Fresh zero pages, only touched as the chains fill
+  htbl->tbl       = calloc(size, sizeof(Quad_list*));
   htbl->dead_quad = malloc(init_dead_size * sizeof(Quad*));
 
   if ( !htbl->blocks || !htbl->tbl || !htbl->dead_quad )
@@ -120,44 +217,38 @@ Hashtbl *hashtbl_new(rule r)
 
   int i;
 
-  for ( i = 0 ; i < init_size ; i++ )
-    htbl->tbl[i] = NULL;
+  for ( i = 0 ; i < 5 ; i++ )
+    htbl->small_count[i] = NULL;
 
-  htbl->dead_quad[0] = &leaves[0];
+  htbl->dead_quad[0] = leaf(0);
 
   for ( i = 1 ; i < htbl->dead_size ; i++ )
     htbl->dead_quad[i] = NULL;
 
-  int k[4];
-
-  for ( k[0] = 0 ; k[0] < leaves_count ; k[0]++ )
-    for ( k[1] = 0 ; k[1] < leaves_count ; k[1]++ )
-      for ( k[2] = 0 ; k[2] < leaves_count ; k[2]++ )
-        for ( k[3] = 0 ; k[3] < leaves_count ; k[3]++ )
-        {
-          Quad *quad[4];
-
-          int j;
-          for ( j = 0 ; j < 4 ; j++ )
-            quad[j] = &leaves[k[j]];
-
-          quad_d1(htbl, quad, r);
-        }
-
+  // Depth 1 nodes are created on demand, as the others
   return htbl;
 }
 
+// Releases whole blocks, the nodes are not visited
 void free_hashtbl(Hashtbl *htbl)
 {
-  free      (htbl->tbl);
-  free      (htbl->dead_quad);
-  free_block(htbl->blocks);
-  free      (htbl);
+  free           (htbl->tbl);
+  free           (htbl->dead_quad);
+  free           (htbl->op_cache);
+  free_block     (htbl->blocks);
+  free_map_block (htbl->map_blocks);
+  free_byte_block(htbl->bytes);
+  free           (htbl);
 }
 
 Quad *leaf(int k)
 {
-  return &leaves[k];
+  return (Quad *) &leaves[k];
+}
+
+int leaf_index(Quad *l)
+{
+  return l - leaves;
 }
 
 Quad *dead_space(Hashtbl *htbl, int d)
@@ -188,10 +279,18 @@ Quad *dead_space(Hashtbl *htbl, int d)
     Quad *ds = dead_space(htbl, d-1);
     Quad *zero[4] = {ds, ds, ds, ds};
 
-    return htbl->dead_quad[d] = cons_quad(htbl, zero, d);
+    htbl->stats.dead_misses++;
+
+    htbl->dead_quad[d] = cons_quad(htbl, zero, d);
+    htbl->dead_quad[d]->flags |= QUAD_KNOWN | QUAD_EMPTY | QUAD_STABLE | QUAD_P2;
+
+    return htbl->dead_quad[d];
   }
   else
+  {
+    htbl->stats.dead_hits++;
     return htbl->dead_quad[d];
+  }
 }
 
 // Prerequisite : the four sub trees were computed and hashed.
@@ -200,6 +299,44 @@ Quad *cons_quad(
   Hashtbl *htbl,
   Quad *quad[4],
   int d)
+{
+  return cons_quad_at(htbl, hashtbl_index(htbl, quad), quad, d);
+}
+
+Quad *cons_find(Hashtbl *htbl, Quad *quad[4])
+{
+  return hashtbl_find(htbl, hashtbl_index(htbl, quad), quad);
+}
+
+// Same as n calls to cons_quad(), but the buckets of all the keys are
+// prefetched before the first one is resolved, so that their cache
+// misses overlap
+void cons_quads(
+  Hashtbl *htbl,
+  Quad *quad[][4],
+  int n,
+  int d,
+  Quad *res[])
+{
+  int h[CONS_BATCH_MAX], i;
+
+  for ( i = 0 ; i < n ; i++ )
+  {
+    h[i] = hashtbl_index(htbl, quad[i]);
+    __builtin_prefetch(&htbl->tbl[h[i]]);
+  }
+
+  // Heads of the chains
+  for ( i = 0 ; i < n ; i++ )
+    if ( htbl->tbl[h[i]] )
+      __builtin_prefetch(htbl->tbl[h[i]]);
+
+  for ( i = 0 ; i < n ; i++ )
+    res[i] = cons_quad_at(htbl, h[i], quad[i], d);
+}
+
+// h is the index of quad in the table
+Quad *cons_quad_at(Hashtbl *htbl, int h, Quad *quad[4], int d)
 {
   if ( quad[0]->depth != quad[1]->depth ||
        quad[0]->depth != quad[2]->depth ||
@@ -207,18 +344,24 @@ Quad *cons_quad(
        quad[0]->depth != d-1 )
     exit(2);
 
-  int h = hash(quad);
-
   // Check if we didn't already memoize requested node
   Quad *q = hashtbl_find(htbl, h, quad);
 
   if ( q )
+  {
+    htbl->stats.cons_hits++;
+    STATS_D(htbl->stats.cons_hits_d, d);
     return q;
+  }
   else
   {
+    htbl->stats.cons_misses++;
+    STATS_D(htbl->stats.cons_misses_d, d);
+
     Quad_list *ql = alloc_quad(htbl);
 
     ql->head.depth = d;
+    ql->head.flags = quad_sig(quad) << 8;
     ql->head.cell_count = NULL;
     ql->head.node.n.next = NULL;
 
@@ -233,83 +376,130 @@ Quad *cons_quad(
   }
 }
 
-/*** Initialize hashlife ***/
-void hashlife_init(void)
+// Center of a depth 1 node after one step
+Quad *step_d1(Hashtbl *htbl, Quad *q)
 {
-  int i;
+  int k[4], i;
+
+  for ( i = 0 ; i < 4 ; i++ )
+    k[i] = leaf_index(q->node.n.sub[i]);
 
-  leaves = malloc(leaves_count * sizeof(Quad));
+  return leaf(rule_lut_step(htbl->lut, k));
+}
 
-  if ( !leaves )
+// Centers of n <= CONS_BATCH_MAX depth 2 nodes after 2^t steps (t <= 1),
+// evolved together as 8x8 bitboards
+void step_d2(Hashtbl *htbl, Quad *q[], int n, int t, Quad *res[])
+{
+  const Rule_kernel *k = rule_lut_kernel(htbl->lut);
+  uint64_t board[CONS_BATCH_MAX];
+  Quad *keys[CONS_BATCH_MAX][4];
+  int b, i, j;
+
+  // Leaf j of the quadrant i: rows 4 * (i >> 1) + 2 * (j >> 1),
+  // columns 4 * (i & 1) + 2 * (j & 1)
+  for ( b = 0 ; b < n ; b++ )
   {
-    perror("hashlife_init()");
-    exit(1);
+    board[b] = 0;
+
+    for ( i = 0 ; i < 4 ; i++ )
+      for ( j = 0 ; j < 4 ; j++ )
+      {
+        const int l = leaf_index(q[b]->node.n.sub[i]->node.n.sub[j]);
+        const int shift = 32 * (i >> 1) + 4 * (i & 1)
+                        + 16 * (j >> 1) + 2 * (j & 1);
+
+        board[b] |= (uint64_t) ((l >> 3 & 1) | (l >> 2 & 1) << 1
+                              | (l >> 1 & 1) << 8 | (l & 1) << 9) << shift;
+      }
   }
 
-  for (i = 0 ; i < leaves_count ; i++)
-  {
-    Quad *q = &leaves[i];
+  flags_d2(k, q, n, board);
 
-    int j;
-    for ( j = 0 ; j < 4 ; j++ )
-      q->node.l.map[j] = (i >> (3 - j)) & 1;
+  for ( i = 0 ; i <= t ; i++ )
+    rule_kernel_step8(k, n, board);
 
-    q->cell_count = NULL;
-    q->depth = 0;
-  }
+  // The 4x4 centers, rows and columns 2 to 5
+  for ( b = 0 ; b < n ; b++ )
+    for ( i = 0 ; i < 4 ; i++ )
+    {
+      const uint64_t c = board[b] >> (18 + 16 * (i >> 1) + 2 * (i & 1));
+
+      keys[b][i] = leaf((c & 1) << 3 | (c >> 1 & 1) << 2
+                      | (c >> 8 & 1) << 1 | (c >> 9 & 1));
+    }
+
+  cons_quads(htbl, keys, n, 1, res);
 }
 
-/* Depth 1 nodes are computed at the beginning of the program */
-// rule : B/S
-// Create depth 1 node
-void quad_d1(Hashtbl *htbl, Quad *quad[4], rule r)
+// Flags of the nodes of the batch which do not have them yet,
+// from their 8x8 boards
+void flags_d2(const Rule_kernel *k, Quad *q[], int n, const uint64_t board[])
 {
-  const int coord[4][8][2] = {
-    {{0,0},{0,1},{1,0},{0,2},{1,2},{2,0},{2,1},{3,0}},
-    {{0,1},{1,0},{1,1},{0,3},{1,3},{2,1},{3,0},{3,1}},
-    {{0,2},{0,3},{1,2},{2,0},{3,0},{2,2},{2,3},{3,2}},
-    {{0,3},{1,2},{1,3},{2,1},{3,1},{2,3},{3,2},{3,3}}
-  },
-  pos[4][2] = {{0,3},{1,2},{2,1},{3,0}};
+  const uint64_t ring1 = 0x007E7E7E7E7E7E00ull, // rows and columns 1 to 6
+                 ring2 = 0x00003C3C3C3C0000ull; // 2 to 5
+  uint64_t b[CONS_BATCH_MAX];
+  Quad *u[CONS_BATCH_MAX];
+  int i, m = 0;
+
+  for ( i = 0 ; i < n ; i++ )
+    if ( !(q[i]->flags & QUAD_KNOWN) )
+    {
+      u[m] = q[i];
+      b[m++] = board[i];
+    }
 
-  Quad_list *ql = alloc_quad(htbl);
+  if ( !m )
+    return;
 
-  ql->head.depth = 1;
-  ql->head.cell_count = NULL;
+  uint64_t b1[CONS_BATCH_MAX];
 
-  int acc = 0, i;
+  for ( i = 0 ; i < m ; i++ )
+    b1[i] = b[i];
 
-  for ( i = 0 ; i < 4 ; ++i )
+  rule_kernel_step8(k, m, b1);
+
+  for ( i = 0 ; i < m ; i++ )
   {
-    int j, sum = 0; 
+    u[i]->flags |= QUAD_KNOWN;
 
-    ql->head.node.n.sub[i] = quad[i];
+    if ( !b[i] )
+      u[i]->flags |= QUAD_EMPTY;
 
-    // Count alive neighbors
-    for ( j = 0 ; j < 8 ; j++ )
-      sum += quad[coord[i][j][0]]->node.l.map[coord[i][j][1]];
-    
-    if ( quad[pos[i][0]]->node.l.map[pos[i][1]] )
-      acc |= ((r >> (sum + 9)) & 1) << (3 - i);
-    else
-      acc |= ((r >> sum) & 1) << (3 - i);
+    if ( !((b1[i] ^ b[i]) & ring1) )
+      u[i]->flags |= QUAD_STABLE | QUAD_P2;
   }
 
-  Quad_map *qm = alloc_map();
+  rule_kernel_step8(k, m, b1);
 
-  if ( !qm )
-  {
-    perror("quad_d1()");
-    exit(1);
-  }
+  for ( i = 0 ; i < m ; i++ )
+    if ( !((b1[i] ^ b[i]) & ring2) )
+      u[i]->flags |= QUAD_P2;
+}
 
-  qm->k = 0;
-  qm->v = &leaves[acc];
-  qm->map_tail = NULL;
+// Sums and products of the signatures of the children, which rotations
+// and reflections permute, but keeping the diagonals together
+unsigned quad_sig(Quad *quad[4])
+{
+  uint32_t sig[4], h;
+  int i;
 
-  ql->head.node.n.next = qm;
+  for ( i = 0 ; i < 4 ; i++ )
+    if ( quad[i]->depth )
+      sig[i] = QUAD_SIG(quad[i]);
+    else
+    {
+      // Same for the cells of a leaf, which are 0 or 1
+      const int *m = quad[i]->node.l.map;
+
+      sig[i] = m[0] + m[1] + m[2] + m[3] + 5 * (m[0] * m[3] + m[1] * m[2]);
+    }
 
-  hashtbl_add(htbl, hash(quad), ql);
+  h = (sig[0] + sig[1] + sig[2] + sig[3]) * 0x9E3779B1u
+    ^ (sig[0] * sig[3] + sig[1] * sig[2]) * 0x85EBCA77u;
+  h ^= h >> 15;
+
+  return h >> 8;
 }
 
 /*** Map functions ***/
@@ -324,11 +514,11 @@ Quad *map_assoc(Quad_map *map, int k)
     return map_assoc(map->map_tail, k);
 }
 
-Quad_map *map_add(Quad_map *map, int k, Quad* v)
+Quad_map *map_add(Hashtbl *htbl, Quad_map *map, int k, Quad* v)
 {
   if ( !map || map->k > k )
   {
-    Quad_map *new_map = alloc_map();
+    Quad_map *new_map = alloc_map(htbl);
     new_map->k = k;
     new_map->v = v;
     new_map->map_tail = map;
@@ -336,11 +526,57 @@ Quad_map *map_add(Quad_map *map, int k, Quad* v)
   }
   else
   {
-    map->map_tail = map_add(map->map_tail, k, v);
+    map->map_tail = map_add(htbl, map->map_tail, k, v);
     return map;
   }
 }
 
+/*** Memoization of operations ***/
+
+Quad *op_find(Hashtbl *htbl, int op, Quad *a, Quad *b)
+{
+  return op_find_at(htbl, op, a, b, 0, 0);
+}
+
+void op_add(Hashtbl *htbl, int op, Quad *a, Quad *b, Quad *v)
+{
+  op_add_at(htbl, op, a, b, 0, 0, v);
+}
+
+Quad *op_find_at(Hashtbl *htbl, int op, Quad *a, Quad *b, int x, int y)
+{
+  if ( !htbl->op_cache )
+    return NULL;
+
+  Op_entry *e = &htbl->op_cache[op_hash(op, a, b, x, y)];
+
+  return e->op == op && e->a == a && e->b == b && e->x == x && e->y == y
+         ? e->v : NULL;
+}
+
+void op_add_at(Hashtbl *htbl, int op, Quad *a, Quad *b, int x, int y, Quad *v)
+{
+  if ( !htbl->op_cache )
+  {
+    htbl->op_cache = calloc(OP_CACHE_SIZE, sizeof(Op_entry));
+
+    if ( !htbl->op_cache )
+    {
+      perror("op_add()");
+      exit(1);
+    }
+  }
+
+  Op_entry *e = &htbl->op_cache[op_hash(op, a, b, x, y)];
+
+  e->op = op;
+  e->x  = x;
+  e->y  = y;
+  e->a  = a;
+  e->b  = b;
+  e->v  = v;
+}
+
 /*** Memory management ***/
 
 Quad_list *alloc_quad(Hashtbl *htbl)
@@ -349,26 +585,34 @@ Quad_list *alloc_quad(Hashtbl *htbl)
 
   if ( htbl->blocks->block_len == BLOCK_MAX_LEN )
   {
-    Quad_block *new_qb = malloc(sizeof(Quad_block));
-    
-    if ( !new_qb )
-    {
-      perror("alloc_quad()");
-      exit(1);
-    }
+    Quad_block *new_qb = new_block();
 
-    new_qb->block_len = 0;
     new_qb->next_block = htbl->blocks;
-
     htbl->blocks = new_qb;
   }
   
   return htbl->blocks->block + htbl->blocks->block_len++;
 }
 
-Quad_map *alloc_map()
+Quad_block *new_block(void)
+{
+  Quad_block *qb = malloc(sizeof(Quad_block));
+
+  if ( !qb )
+  {
+    perror("new_block()");
+    exit(1);
+  }
+
+  qb->next_block = NULL;
+  qb->block_len  = 0;
+
+  return qb;
+}
+
+Quad_map *alloc_map(Hashtbl *htbl)
 {
-  if ( !map_blocks || map_blocks->m_block_len == BLOCK_MAX_LEN )
+  if ( !htbl->map_blocks || htbl->map_blocks->m_block_len == BLOCK_MAX_LEN )
   {
     Map_block *new_mb = malloc(sizeof(Map_block));
 
@@ -378,46 +622,109 @@ Quad_map *alloc_map()
       exit(1);
     }
 
-    new_mb->m_block_len   = 0;
-    new_mb->m_block_alive = 0;
-    new_mb->next_m_block  = map_blocks;
+    new_mb->m_block_len  = 0;
+    new_mb->next_m_block = htbl->map_blocks;
 
-    int i;
-    for ( i = 0 ; i < BLOCK_MAX_LEN ; i++ )
-      new_mb->m_block[i].qm_block = new_mb;
+    htbl->map_blocks = new_mb;
+  }
+
+  return htbl->map_blocks->m_block + htbl->map_blocks->m_block_len++;
+}
+
+void *hashtbl_alloc(Hashtbl *htbl, size_t size)
+{
+  // Aligned as pointers
+  size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  Byte_block *bb = htbl->bytes;
+
+  if ( !bb || bb->b_block_len + size > bb->b_block_size )
+  {
+    const size_t block_size = size > BYTE_BLOCK_LEN ? size : BYTE_BLOCK_LEN;
+
+    bb = malloc(sizeof(Byte_block));
 
-    map_blocks = new_mb;
+    if ( !bb || !(bb->b_block = malloc(block_size)) )
+    {
+      perror("hashtbl_alloc()");
+      exit(1);
+    }
+
+    bb->b_block_len  = 0;
+    bb->b_block_size = block_size;
+    bb->next_b_block = htbl->bytes;
+
+    htbl->bytes = bb;
   }
 
-  map_blocks->m_block_alive++;
+  void *p = bb->b_block + bb->b_block_len;
+  bb->b_block_len += size;
 
-  return map_blocks->m_block + map_blocks->m_block_len++;
+  return p;
 }
 
-void map_block_compact()
+const BigInt *hashtbl_small_count(Hashtbl *htbl, int k)
 {
-  map_blocks = map_block_compact_(map_blocks);
+  if ( !htbl->small_count[k] )
+  {
+    BigInt *b = bi_from_int(k);
+
+    htbl->small_count[k] = bi_pack(b, hashtbl_alloc(htbl, bi_packed_size(b)));
+    bi_free(b);
+  }
+
+  return htbl->small_count[k];
 }
 
-Map_block *map_block_compact_(Map_block *qb)
+/* Stop & copy: the nodes are copied into new blocks, depth first from the
+ * roots, and the old blocks are released. A copied node leaves its depth
+ * to -1 and the address of its copy in the tail of its cell. The memoized
+ * results are copied with their nodes, the populations are packed again
+ * and the operation cache is dropped. */
+void hashtbl_compact(Hashtbl *htbl, Quad *roots[], int n)
 {
-  if ( qb )
+  Quad_block *old_blocks = htbl->blocks;
+  Map_block  *old_maps   = htbl->map_blocks;
+  Byte_block *old_bytes  = htbl->bytes;
+  const int before = htbl->count;
+  int i, fresh;
+
+  htbl->blocks     = new_block();
+  htbl->map_blocks = NULL;
+  htbl->bytes      = NULL;
+  htbl->count      = 0;
+
+  for ( i = 0 ; i < 5 ; i++ )
+    htbl->small_count[i] = NULL;
+
+  for ( i = 0 ; i < n ; i++ )
   {
-    Map_block *next = map_block_compact_(qb->next_m_block);
+    roots[i] = gc_forward(htbl, roots[i], &fresh);
 
-    if ( qb->m_block_alive )
-    {
-      qb->next_m_block = next;
-      return qb;
-    }
-    else
-    {
-      free(qb);
-      return next;
-    }
+    if ( fresh )
+      gc_scan(htbl, roots[i]);
   }
-  else
-    return NULL;
+
+  for ( i = 1 ; i < htbl->dead_size && htbl->dead_quad[i] ; i++ )
+  {
+    htbl->dead_quad[i] = gc_forward(htbl, htbl->dead_quad[i], &fresh);
+
+    if ( fresh )
+      gc_scan(htbl, htbl->dead_quad[i]);
+  }
+
+  hashtbl_rehash(htbl);
+
+  free(htbl->op_cache);
+  htbl->op_cache = NULL;
+
+  free_block(old_blocks);
+  free_map_block(old_maps);
+  free_byte_block(old_bytes);
+
+  htbl->live = htbl->count;
+  htbl->stats.compactions++;
+  htbl->stats.compact_freed += before - htbl->count;
 }
 
 /*** Hashtable functions ***/
@@ -432,7 +739,13 @@ void binary(intptr_t w)
 }
 */
 
-int hash(Quad* key[4])
+int hashtbl_index(Hashtbl *htbl, Quad *key[4])
+{
+  return (int) (htbl->hash_fn(key) & (htbl->size - 1));
+}
+
+// Mixes the pointer values, the low bits depend on the allocator
+uint64_t hash_legacy(Quad *key[4])
 {
   intptr_t a[4], x;
   int i;
@@ -442,26 +755,80 @@ int hash(Quad* key[4])
 
   x = (a[0] * a[3]) / 1000 ^ (a[2] * a[1]) / 68 ^ (a[1] * a[3] >> 12) ^ (a[0] >> 4);
 
-  /* sample
-  static int t = 0;
+  return (uint64_t) x;
+}
 
-  t++;
+// Multiply then xorshift each child in turn, with a final avalanche
+uint64_t hash_mulxor(Quad *key[4])
+{
+  uint64_t h = 0x9E3779B97F4A7C15u;
+  int i;
 
-  if ( !(t % 20021) )
+  for ( i = 0 ; i < 4 ; i++ )
   {
-    binary(a[0]);
-    binary(a[1]);
-    binary(a[2]);
-    binary(a[3]);
+    h = (h ^ (uint64_t) (uintptr_t) key[i]) * 0xBF58476D1CE4E5B9u;
+    h ^= h >> 31;
   }
-  */
 
-  return (int) x & (init_size - 1);
+  h *= 0x94D049BB133111EBu;
+  h ^= h >> 29;
+
+  return h;
+}
+
+// wyhash style: 64x64 -> 128 bit multiplications folded by xor
+uint64_t hash_wy(Quad *key[4])
+{
+  const uint64_t s0 = 0xA0761D6478BD642Fu, s1 = 0xE7037ED1A0B428DBu,
+                 s2 = 0x8EBC6AF09C88C6E3u, s3 = 0x589965CC75374CC3u;
+
+  const uint64_t a = wymix((uintptr_t) key[0] ^ s0, (uintptr_t) key[1] ^ s1),
+                 b = wymix((uintptr_t) key[2] ^ s2, (uintptr_t) key[3] ^ s3);
+
+  return wymix(a ^ s1, b ^ s0);
+}
+
+uint64_t wymix(uint64_t a, uint64_t b)
+{
+  const unsigned __int128 r = (unsigned __int128) a * b;
+  return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+int op_hash(int op, Quad *a, Quad *b, int x, int y)
+{
+  uintptr_t h = (uintptr_t) a * 0x9E3779B1u ^ (uintptr_t) b * 0x85EBCA77u
+              ^ (uintptr_t) x * 0x27D4EB2Fu ^ (uintptr_t) y * 0x165667B1u ^ op;
+
+  h ^= h >> 15;
+  h *= 0xC2B2AE3Du;
+  h ^= h >> 13;
+
+  return (int) (h & (OP_CACHE_SIZE - 1));
+}
+
+// Rebuilds the chains after a change of hash function
+void hashtbl_rehash(Hashtbl *htbl)
+{
+  Quad_block *qb;
+  int i;
+
+  for ( i = 0 ; i < htbl->size ; i++ )
+    htbl->tbl[i] = NULL;
+
+  for ( qb = htbl->blocks ; qb ; qb = qb->next_block )
+    for ( i = 0 ; i < qb->block_len ; i++ )
+      hashtbl_add(htbl, hashtbl_index(htbl, qb->block[i].head.node.n.sub),
+                  &qb->block[i]);
 }
 
 Quad *hashtbl_find(Hashtbl *htbl, int h, Quad* key[4])
 {
-  return list_find(key, htbl->tbl[h]);
+  int probes = 0;
+  Quad *q = list_find(key, htbl->tbl[h], &probes);
+
+  STATS_D(htbl->stats.probes, probes < STATS_PROBE ? probes : STATS_PROBE - 1);
+
+  return q;
 }
 
 void hashtbl_add(Hashtbl *htbl, int h, Quad_list *elt)
@@ -470,16 +837,19 @@ void hashtbl_add(Hashtbl *htbl, int h, Quad_list *elt)
   htbl->tbl[h] = elt;
 }
 
-Quad *list_find(Quad* key[4], Quad_list *list)
+// probes is incremented for each node compared to the key
+Quad *list_find(Quad* key[4], Quad_list *list, int *probes)
 {
   if ( !list )
     return NULL;
   else
   {
+    (*probes)++;
+
     int i;
     for ( i = 0 ; i < 4 ; i++ )
       if ( key[i] != list->head.node.n.sub[i] )
-        return list_find(key, list->tail);
+        return list_find(key, list->tail, probes);
     return &list->head;
   }
 }
@@ -488,31 +858,95 @@ void free_block(Quad_block *qb)
 {
   while ( qb )
   {
-    int i;
-    for ( i = 0 ; i < qb->block_len ; i++ )
-      free_quad(&qb->block[i].head);
-
     Quad_block *next = qb->next_block;
     free(qb);
     qb = next;
   }
 }
 
-void free_quad(Quad *q)
+void free_map_block(Map_block *mb)
+{
+  while ( mb )
+  {
+    Map_block *next = mb->next_m_block;
+    free(mb);
+    mb = next;
+  }
+}
+
+void free_byte_block(Byte_block *bb)
 {
+  while ( bb )
+  {
+    Byte_block *next = bb->next_b_block;
+    free(bb->b_block);
+    free(bb);
+    bb = next;
+  }
+}
+
+// Copy of q, *fresh is set when it was made by this call
+Quad *gc_forward(Hashtbl *htbl, Quad *q, int *fresh)
+{
+  Quad_list *cell = (Quad_list *) q;
+
+  *fresh = 0;
+
+  if ( q->depth == 0 )
+    return q;
+  else if ( q->depth < 0 )
+    return &cell->tail->head;
+
+  Quad_list *copy = alloc_quad(htbl);
+
+  copy->head = *q;
+
   if ( q->cell_count )
-    bi_free(q->cell_count);
-  free_map(q->node.n.next);
+    copy->head.cell_count = bi_pack(q->cell_count,
+      hashtbl_alloc(htbl, bi_packed_size(q->cell_count)));
+
+  q->depth = -1;
+  cell->tail = copy;
+  *fresh = 1;
+
+  return &copy->head;
 }
 
-void free_map(Quad_map *qm)
+// q was just copied: its children are copied next to each other, then
+// their subtrees, then the memoized results
+void gc_scan(Hashtbl *htbl, Quad *q)
 {
-  if ( qm )
+  int fresh[4], i;
+
+  for ( i = 0 ; i < 4 ; i++ )
+    q->node.n.sub[i] = gc_forward(htbl, q->node.n.sub[i], &fresh[i]);
+
+  Quad_map *m, **last = &q->node.n.next;
+
+  for ( m = q->node.n.next ; m ; m = m->map_tail )
+  {
+    Quad_map *copy = alloc_map(htbl);
+
+    copy->k = m->k;
+    copy->v = m->v;
+    copy->map_tail = NULL;
+
+    *last = copy;
+    last = &copy->map_tail;
+  }
+
+  for ( i = 0 ; i < 4 ; i++ )
+    if ( fresh[i] )
+      gc_scan(htbl, q->node.n.sub[i]);
+
+  for ( m = q->node.n.next ; m ; m = m->map_tail )
   {
-    qm->qm_block->m_block_alive--;
-    qm->qm_block = NULL;
-    free_map(qm->map_tail);
-    // v member is going to be freed outside as it should be in the hashtbl
+    int f;
+
+    m->v = gc_forward(htbl, m->v, &f);
+
+    if ( f )
+      gc_scan(htbl, m->v);
   }
 }
 
@@ -553,7 +987,7 @@ int list_length(Quad_list *list)
 void hashtbl_stat(Hashtbl *htbl)
 {
   int i, max[BUCKET_COUNT] = {0};
-  for ( i = 0 ; i < init_size ; i++ )
+  for ( i = 0 ; i < htbl->size ; i++ )
   {
     int l = list_length(htbl->tbl[i]);
     max[l >= BUCKET_COUNT ? BUCKET_COUNT - 1 : l]++;
@@ -569,15 +1003,206 @@ void hashtbl_stat(Hashtbl *htbl)
   return;
 }
 
-const int *step(Hashtbl *htbl, int state[4])
+void hashtbl_stats_json(Hashtbl *htbl, FILE *file)
 {
-  Quad *quad[4];
-  int i;
+  int i, max[BUCKET_COUNT] = {0};
+  for ( i = 0 ; i < htbl->size ; i++ )
+  {
+    int l = list_length(htbl->tbl[i]);
+    max[l >= BUCKET_COUNT ? BUCKET_COUNT - 1 : l]++;
+  }
 
-  for ( i = 0 ; i < 4 ; i++ )
-    quad[i] = &leaves[state[i]];
+  int len = BUCKET_COUNT;
+  while ( len > 0 && !max[len-1] )
+    len--;
+
+  fprintf(file, "{\n  \"nodes\": %d,\n  \"buckets\": %d,\n",
+          htbl->count, htbl->size);
+
+  // chains[i]: buckets holding i nodes
+  fprintf(file, "  \"chains\": [");
+  for ( i = 0 ; i < len ; i++ )
+    fprintf(file, "%s%d", i ? ", " : "", max[i]);
+  fprintf(file, "],\n");
+
+  stats_write_json(file, &htbl->stats);
+
+  fprintf(file, "}\n");
+  fflush(file);
+}
+
+/*** Hash functions ***/
+
+int hash_by_name(const char *name)
+{
+  int k;
+  for ( k = 0 ; k < HASH_KINDS ; k++ )
+    if ( strcmp(name, hash_family[k].name) == 0 )
+      return k;
 
-  Quad *q = hashtbl_find(htbl, hash(quad), quad);
+  return -1;
+}
+
+const char *hash_name(int kind)
+{
+  return hash_family[kind].name;
+}
+
+void hashtbl_set_hash(Hashtbl *htbl, int kind)
+{
+  if ( kind == htbl->hash_kind )
+    return;
+
+  htbl->hash_kind = kind;
+  htbl->hash_fn   = hash_family[kind].fn;
+
+  hashtbl_rehash(htbl);
+}
+
+// Distribution of the nodes of the table under each hash function
+void hashtbl_analyze(Hashtbl *htbl, FILE *file)
+{
+  const double n = htbl->count, m = htbl->size, lambda = n / m;
+
+  // Chains longer than 255 are counted as 255
+  unsigned char *chain = malloc(htbl->size);
+
+  if ( !chain )
+  {
+    perror("hashtbl_analyze()");
+    exit(1);
+  }
+
+  fprintf(file, "%d nodes, %d buckets, load %.4f\n", htbl->count,
+          htbl->size, lambda);
+  fprintf(file, "%-8s %8s %10s %10s %10s %6s %8s\n", "hash", "ns/key",
+          "occupied", "expected", "chi2_z", "max", "probes");
+
+  int k;
+  for ( k = 0 ; k < HASH_KINDS ; k++ )
+  {
+    const Hash_fn fn = hash_family[k].fn;
+    struct timespec t0, t1;
+    Quad_block *qb;
+    int i;
 
-  return q->node.n.next->v->node.l.map;
+    memset(chain, 0, htbl->size);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for ( qb = htbl->blocks ; qb ; qb = qb->next_block )
+      for ( i = 0 ; i < qb->block_len ; i++ )
+      {
+        unsigned char *c = &chain[fn(qb->block[i].head.node.n.sub) & (htbl->size - 1)];
+
+        if ( *c < 255 )
+          (*c)++;
+      }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double occupied = 0, chi2 = 0, probes = 0;
+    int max = 0;
+
+    for ( i = 0 ; i < htbl->size ; i++ )
+    {
+      const double c = chain[i];
+
+      if ( c )
+        occupied++;
+      if ( chain[i] > max )
+        max = chain[i];
+
+      chi2   += c * c;
+      probes += c * (c + 1) / 2;
+    }
+
+    // sum (c - lambda)^2 / lambda, as a deviation from its expected value
+    chi2 = chi2 / lambda - n;
+
+    fprintf(file, "%-8s %8.2f %10.0f %10.0f %10.2f %6d %8.4f%s\n",
+            hash_family[k].name,
+            ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n,
+            occupied, m * (1 - exp(-lambda)),
+            (chi2 - (m - 1)) / sqrt(2 * (m - 1)), max, probes / n,
+            k == htbl->hash_kind ? " (current)" : "");
+  }
+
+  free(chain);
+}
+
+Stats *hashtbl_stats(Hashtbl *htbl)
+{
+  return &htbl->stats;
+}
+
+void hashtbl_set_progress(Hashtbl *htbl, struct Progress *p)
+{
+  htbl->progress = p;
+}
+
+struct Progress *hashtbl_progress(Hashtbl *htbl)
+{
+  return htbl->progress;
+}
+
+void hashtbl_set_trace(Hashtbl *htbl, struct Trace *tr)
+{
+  htbl->trace = tr;
+}
+
+struct Trace *hashtbl_trace(Hashtbl *htbl)
+{
+  return htbl->trace;
+}
+
+void hashtbl_set_perfctr(Hashtbl *htbl, struct Perfctr *pc)
+{
+  htbl->perfctr = pc;
+}
+
+struct Perfctr *hashtbl_perfctr(Hashtbl *htbl)
+{
+  return htbl->perfctr;
+}
+
+void hashtbl_set_symmetry(Hashtbl *htbl, int on)
+{
+  htbl->symmetry = on;
+}
+
+int hashtbl_symmetry(Hashtbl *htbl)
+{
+  return htbl->symmetry;
+}
+
+void hashtbl_set_compaction(Hashtbl *htbl, int on)
+{
+  htbl->compaction = on;
+}
+
+int hashtbl_compaction_due(Hashtbl *htbl)
+{
+  return htbl->compaction && htbl->count >= compact_min &&
+         htbl->count >= 2 * htbl->live;
+}
+
+rule hashtbl_rule(Hashtbl *htbl)
+{
+  return htbl->r;
+}
+
+const Rule_kernel *hashtbl_kernel(Hashtbl *htbl)
+{
+  return rule_lut_kernel(htbl->lut);
+}
+
+int hashtbl_count(Hashtbl *htbl)
+{
+  return htbl->count;
+}
+
+const int *step(Hashtbl *htbl, int state[4])
+{
+  return leaf(rule_lut_step(htbl->lut, state))->node.l.map;
 }
@@ -1,8 +1,10 @@
 #ifndef HASHTBL_H
 #define HASHTBL_H
+#include <stdio.h>
 #include <stdint.h>
 #include "definitions.h"
 #include "bigint.h"
+#include "stats.h"
 
 typedef struct Hashtbl Hashtbl;
 typedef struct Quad_map Quad_map;
@@ -31,29 +33,149 @@ union Node
 struct Quad
 {
   int         depth;      // quad tree for a square map with side 2^(depth+1)
+  int         flags;      // Quad_flag, and the signature above QUAD_FLAGS
   BigInt     *cell_count;
   union Node  node;
 };
 
+/* Properties of the nodes of depth >= 2, computed when fate() first
+ * evolves them. A node is stable when one step leaves its cells unchanged,
+ * except maybe the outer ring of width 1, and period 2 when two steps
+ * leave them unchanged, except the outer ring of width 2: then the center
+ * is the same after any number of steps (resp. any even number). */
+enum Quad_flag
+{
+  QUAD_KNOWN  = 1, // the other flags are set
+  QUAD_EMPTY  = 2, // dead cells only
+  QUAD_STABLE = 4,
+  QUAD_P2     = 8, // also set for the stable nodes
+};
+
+#define QUAD_FLAGS 0xFF
+
+/* The signature of a node only depends on its cells up to rotations and
+ * reflections: its images share it. Dead cells have signature 0. */
+#define QUAD_SIG(q) ((unsigned) (q)->flags >> 8)
+
 /********************/
 
 Hashtbl *hashtbl_new(rule r);
+// With size buckets (a power of 2) instead of 2^25
+Hashtbl *hashtbl_new_sized(rule r, int size);
 void free_hashtbl(Hashtbl*);
 
-void hashlife_init(void);
 
 Quad *leaf(int k);
+int   leaf_index(Quad *l); // inverse of leaf()
+// Depth 1 node evolved by one step
+Quad *step_d1(Hashtbl *htbl, Quad *q);
 Quad *dead_space(Hashtbl *htbl, int d);
 Quad *cons_quad(
   Hashtbl *htbl,
   Quad *quad[4],
   int d);
 
+// The node if it is in the table, NULL otherwise (it is not created)
+Quad *cons_find(Hashtbl *htbl, Quad *quad[4]);
+
+// n <= CONS_BATCH_MAX calls to cons_quad() at once, res[i] for quad[i].
+// The lookups overlap their memory accesses.
+#define CONS_BATCH_MAX 16
+
+void  cons_quads(
+  Hashtbl *htbl,
+  Quad *quad[][4],
+  int n,
+  int d,
+  Quad *res[]);
+
+// Centers of n <= CONS_BATCH_MAX depth 2 nodes after 2^t steps, t <= 1
+void step_d2(Hashtbl *htbl, Quad *q[], int n, int t, Quad *res[]);
+
+// Hash functions of the nodes, on the addresses of their children
+enum Hash_kind { HASH_LEGACY, HASH_MULXOR, HASH_WY, HASH_KINDS };
+
+#define HASH_DEFAULT HASH_LEGACY
+
+// -1 for an unknown name
+int         hash_by_name(const char *name);
+const char *hash_name(int kind);
+// Rehashes the nodes already in the table
+void        hashtbl_set_hash(Hashtbl *htbl, int kind);
+// Bucket of the node of children key, by the hash function of the table
+int         hashtbl_index(Hashtbl *htbl, Quad *key[4]);
+// Bucket occupancy, chi-square, longest chain, average probes and speed
+// of every hash function, on the nodes of the table
+void        hashtbl_analyze(Hashtbl *htbl, FILE *file);
+
 Quad     *map_assoc(Quad_map*, int);
-Quad_map *map_add(Quad_map*, int, Quad*);
+Quad_map *map_add(Hashtbl*, Quad_map*, int, Quad*);
+
+// Memory released with the table, for data attached to its nodes
+void     *hashtbl_alloc(Hashtbl*, size_t);
+// k in 0..4, for the populations of the leaves which are shared by all
+// tables and thus do not cache their own
+const BigInt *hashtbl_small_count(Hashtbl*, int k);
+
+// Memo of binary operations, keyed by an operation tag and two nodes.
+// A lookup may fail even if the result was added before.
+enum Op_tag { OP_OR, OP_AND, OP_XOR, OP_ANDNOT, OP_PULL, OP_SYM, OP_SYM_FATE };
+
+Quad *op_find(Hashtbl *htbl, int op, Quad *a, Quad *b);
+void  op_add(Hashtbl *htbl, int op, Quad *a, Quad *b, Quad *v);
+
+// Same, for operations which also depend on a pair of integers
+Quad *op_find_at(Hashtbl *htbl, int op, Quad *a, Quad *b, int x, int y);
+void  op_add_at(Hashtbl *htbl, int op, Quad *a, Quad *b, int x, int y, Quad *v);
 
 void       print_quad(Quad*);
+
+// Copies the nodes reachable from the n roots, by their children and
+// their memoized results, depth first into new blocks, and releases the
+// others. The roots are updated, any other pointer to a node is invalid.
+void       hashtbl_compact(Hashtbl *htbl, Quad *roots[], int n);
+
+// The simulations compact the table between their steps when it is due
+// (off by default): then only the roots they hold survive their steps, so
+// a table with compaction on is used by one of them at a time, and no
+// other pointer to its nodes is kept across their steps. destiny() does
+// not compact: its few long steps showed no gain.
+void       hashtbl_set_compaction(Hashtbl*, int on);
+// Compaction is on, and the table has doubled since the last one
+// (from a million nodes on)
+int        hashtbl_compaction_due(Hashtbl*);
+
 void       hashtbl_stat(Hashtbl*);
+// Table occupancy and counters as a JSON object, can be called at any time
+void       hashtbl_stats_json(Hashtbl*, FILE*);
+Stats     *hashtbl_stats(Hashtbl*);
+int        hashtbl_count(Hashtbl*);
+
+// Progress reports of long evolutions (see progress.h), NULL for none
+struct Progress;
+void             hashtbl_set_progress(Hashtbl*, struct Progress*);
+struct Progress *hashtbl_progress(Hashtbl*);
+
+// Trace of the fate() calls (see trace.h), NULL for none
+struct Trace;
+void             hashtbl_set_trace(Hashtbl*, struct Trace*);
+struct Trace    *hashtbl_trace(Hashtbl*);
+
+// fate() also looks for the results of the rotations and reflections
+// of the nodes it evolves (off by default)
+void hashtbl_set_symmetry(Hashtbl*, int on);
+int  hashtbl_symmetry(Hashtbl*);
+
+rule hashtbl_rule(Hashtbl*);
+
+// Compiled rule of the table (see rulekernel.h)
+struct Rule_kernel;
+const struct Rule_kernel *hashtbl_kernel(Hashtbl*);
+
+// Hardware counters around sampled fate() calls (see perfctr.h)
+struct Perfctr;
+void             hashtbl_set_perfctr(Hashtbl*, struct Perfctr*);
+struct Perfctr  *hashtbl_perfctr(Hashtbl*);
 const int *step(Hashtbl*, int[4]);
 
 #endif
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "bigint.h"
+#include "simulation.h"
+#include "history.h"
+
+struct History
+{
+  int        capacity;
+  int        len;
+  int        next;     // slot to be written by the next record
+  Sim_state *ring;
+};
+
+/**************************************************/
+
+History *history_new(int capacity)
+{
+  History *hist = malloc(sizeof(History));
+
+  if ( !hist )
+  {
+    perror("history_new()");
+    exit(1);
+  }
+
+  hist->capacity = capacity;
+  hist->len      = 0;
+  hist->next     = 0;
+  hist->ring     = capacity ? malloc(capacity * sizeof(Sim_state)) : NULL;
+
+  if ( capacity && !hist->ring )
+  {
+    perror("history_new()");
+    exit(1);
+  }
+
+  return hist;
+}
+
+void history_free(History *hist)
+{
+  int i;
+  for ( i = 0 ; i < hist->len ; i++ )
+  {
+    bi_free(hist->ring[i].gen);
+    bi_free(hist->ring[i].offset);
+  }
+
+  free(hist->ring);
+  free(hist);
+}
+
+void history_record(History *hist, const Sim_state *s)
+{
+  if ( hist->capacity == 0 )
+    return;
+
+  // The generations only grow between two jumps back
+  int last = (hist->next + hist->capacity - 1) % hist->capacity;
+
+  if ( hist->len && bi_cmp(hist->ring[last].gen, s->gen) == 0 )
+    return;
+
+  Sim_state *slot = &hist->ring[hist->next];
+
+  if ( hist->len == hist->capacity )
+  {
+    bi_free(slot->gen);
+    bi_free(slot->offset);
+  }
+  else
+    hist->len++;
+
+  slot->gen    = bi_copy(s->gen);
+  slot->root   = s->root;
+  slot->offset = bi_copy(s->offset);
+
+  hist->next = (hist->next + 1) % hist->capacity;
+}
+
+const Sim_state *history_nearest(History *hist, const BigInt *t)
+{
+  const Sim_state *best = NULL;
+
+  int i;
+  for ( i = 0 ; i < hist->len ; i++ )
+  {
+    const Sim_state *s = &hist->ring[i];
+
+    if ( bi_cmp(s->gen, t) <= 0 && (!best || bi_cmp(best->gen, s->gen) < 0) )
+      best = s;
+  }
+
+  return best;
+}
+
+int history_len(History *hist)
+{
+  return hist->len;
+}
+
+const Sim_state *history_get(History *hist, int i)
+{
+  return &hist->ring[i];
+}
+
+void history_set_root(History *hist, int i, Quad *q)
+{
+  hist->ring[i].root = q;
+}
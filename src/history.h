@@ -0,0 +1,33 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "bigint.h"
+#include "simulation.h"
+
+/* Ring of recorded generations.
+ * A snapshot only costs its root pointer, as nodes are shared. The roots
+ * are kept by the compactions of the table (see sim_compact()), which
+ * move them. The oldest snapshot is overwritten when the ring is full. */
+
+// Nothing is recorded with a capacity of 0
+
+typedef struct History History;
+
+History *history_new(int capacity);
+void     history_free(History *hist);
+
+// The BigInt fields of s are copied. A generation equal to the last
+// recorded one is skipped.
+void history_record(History *hist, const Sim_state *s);
+
+// Most advanced recorded generation which is not after t,
+// NULL if there is none.
+// The lifetime of the result is until the next history_record().
+const Sim_state *history_nearest(History *hist, const BigInt *t);
+
+int              history_len(History *hist);
+const Sim_state *history_get(History *hist, int i);
+// After the root of snapshot i was moved
+void             history_set_root(History *hist, int i, Quad *q);
+
+#endif
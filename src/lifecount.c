@@ -4,26 +4,34 @@
 #include "bigint.h"
 #include "hashtbl.h"
 
-const BigInt *cell_count_(Quad *);
+const BigInt *cell_count_(Hashtbl *, Quad *);
 
-const BigInt *cell_count(Quad *q)
+const BigInt *cell_count(Hashtbl *htbl, Quad *q)
 {
-  return cell_count_(q);
+  return cell_count_(htbl, q);
 }
 
-const BigInt *cell_count_(Quad *q)
+// Populations are allocated in the table,
+// the leaves are shared by all tables and do not keep theirs
+const BigInt *cell_count_(Hashtbl *htbl, Quad *q)
 {
   if ( q->cell_count )
     return q->cell_count;
+  else if ( q->flags & QUAD_EMPTY )
+    return hashtbl_small_count(htbl, 0);
   else if ( q->depth > 0 )
   {
     BigInt *tmp[2];
     int i;
     for ( i = 0 ; i < 2 ; i++ )
-        tmp[i] = bi_add(cell_count_(q->node.n.sub[2*i]),
-                        cell_count_(q->node.n.sub[2*i+1]));
-    q->cell_count = bi_add(tmp[0], tmp[1]);
+        tmp[i] = bi_add(cell_count_(htbl, q->node.n.sub[2*i]),
+                        cell_count_(htbl, q->node.n.sub[2*i+1]));
 
+    BigInt *sum = bi_add(tmp[0], tmp[1]);
+
+    q->cell_count = bi_pack(sum, hashtbl_alloc(htbl, bi_packed_size(sum)));
+
+    bi_free(sum);
     bi_free(tmp[0]);
     bi_free(tmp[1]);
 
@@ -35,7 +43,7 @@ const BigInt *cell_count_(Quad *q)
     for ( i = 0 ; i < 4 ; i++ )
       k += q->node.l.map[i];
 
-    return q->cell_count = bi_from_int(k);
+    return hashtbl_small_count(htbl, k);
   }
 }
 
@@ -6,6 +6,6 @@
 
 /* The lifetime of the result is that of the Quad element
  * which itself is that of the hashtable that generated it */
-const BigInt *cell_count(Quad *q);
+const BigInt *cell_count(Hashtbl *htbl, Quad *q);
 
 #endif
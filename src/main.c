@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "definitions.h"
 #include "darray.h"
 #include "bigint.h"
@@ -11,13 +12,33 @@
 #include "parsers.h"
 #include "runlength.h"
 #include "prgrph.h"
+#include "progress.h"
+#include "trace.h"
+#include "perfctr.h"
+#include "adaptive.h"
+#include "sparsemap.h"
+#include "slowlife.h"
+#include "simulation.h"
+#include "escape.h"
+#include "quadops.h"
 
-void test_quad(Hashtbl*, Quad*, BigInt *, int);
+enum { ENGINE_HASHLIFE, ENGINE_SPARSE, ENGINE_AUTO };
+
+// Generations visited with -J before t
+#define MAX_JUMPS 8
+
+void test_quad(Hashtbl*, Progress*, Quad*, BigInt *, int, int, int,
+               BigInt **, int);
 
 const char *get_filename_ext(const char *filename);
 
+int   op_by_name(const char *name);
+Quad *read_operand(Hashtbl *htbl, const char *path);
+
 const char *collect_arg3(char *argv, BigInt **t);
 
+void write_stats(Hashtbl *htbl, const char *path);
+
 int main(int argc, char *argv[])
 {
   const rule conway = 6152; // parse_rule("b3/s23");
@@ -27,6 +48,78 @@ int main(int argc, char *argv[])
   char *filename;
   FILE *file;
 
+  const char *stats_file = NULL;
+  const char *trace_file = NULL;
+  double interval = 0;
+  int trace_depth = 8, trace_sample = 1, perf_sample = -1;
+  int hash_kind = HASH_DEFAULT, analyze = 0, fast_exit = 0, symmetry = 0,
+      prune = 0, compaction = 0, n_jumps = 0, i, op = -1;
+  BigInt *jumps[MAX_JUMPS];
+  const char *op_file = NULL;
+  int engine = ENGINE_HASHLIFE;
+  int opt;
+
+  while ( (opt = getopt(argc, argv, "s:p:T:m:r:P:H:E:J:O:AFSGC")) != -1 )
+  {
+    switch ( opt )
+    {
+      case 's': stats_file = optarg; break;
+      case 'p': interval = atof(optarg); break;
+      case 'T': trace_file = optarg; break;
+      case 'm': trace_depth = atoi(optarg); break;
+      case 'r': trace_sample = atoi(optarg); break;
+      case 'P': perf_sample = atoi(optarg); break;
+      case 'H':
+        if ( (hash_kind = hash_by_name(optarg)) < 0 )
+        {
+          fprintf(stderr, "unknown hash function %s\n", optarg);
+          argc = 0;
+        }
+        break;
+      case 'E':
+        if ( strcmp(optarg, "sparse") == 0 )
+          engine = ENGINE_SPARSE;
+        else if ( strcmp(optarg, "auto") == 0 )
+          engine = ENGINE_AUTO;
+        else if ( strcmp(optarg, "hashlife") != 0 )
+        {
+          fprintf(stderr, "unknown engine %s\n", optarg);
+          argc = 0;
+        }
+        break;
+      case 'J':
+        if ( n_jumps == MAX_JUMPS )
+        {
+          fprintf(stderr, "at most %d jumps\n", MAX_JUMPS);
+          argc = 0;
+        }
+        else
+          jumps[n_jumps++] = bi_from_string(optarg, 10);
+        break;
+      case 'O':
+        op_file = strchr(optarg, ':');
+
+        if ( !op_file || (op = op_by_name(optarg)) < 0 )
+        {
+          fprintf(stderr, "expected or|and|xor|andnot:file\n");
+          argc = 0;
+        }
+        else
+          op_file++;
+        break;
+      case 'A': analyze = 1; break;
+      case 'F': fast_exit = 1; break;
+      case 'S': symmetry = 1; break;
+      case 'G': prune = 1; break;
+      case 'C': compaction = 1; break;
+      default: argc = 0;
+    }
+  }
+
+  // Positional arguments, as if there were no options
+  argv += optind - 1;
+  argc -= optind - 1;
+
   switch ( argc )
   {
     case 4:
@@ -37,19 +130,69 @@ int main(int argc, char *argv[])
 
       file = fopen(filename, "r");
 
+      Progress *prog = progress_new(stderr, interval);
+      Perfctr *pc = perf_sample >= 0 ? perfctr_new(perf_sample) : NULL;
 
-      Hashtbl *htbl = hashtbl_new(conway);
-      Quad *q;
+      progress_set_perfctr(prog, pc);
+
+      progress_phase(prog, "parse");
+
+      Rle *rle = NULL;
+      Prgrph p;
+      rule r = conway;
 
       if ( strcmp(get_filename_ext(filename), "rle") == 0 )
       {
-        Rle *rle = read_rle(file);
+        rle = read_rle(file);
 
         write_rle(stdout, rle);
         
         printf("___\n");
         fflush(stdout);
 
+        // The rule of the header, if any
+        if ( rle->rle_meta.rle_r )
+          r = rle->rle_meta.rle_r;
+
+        // Hashlife needs the dead space to stay dead
+        if ( r & 1 )
+        {
+          fprintf(stderr, "B0 rules are not supported\n");
+          exit(1);
+        }
+      }
+      else
+        p = read_prgrph(file);
+
+      progress_phase(prog, "init");
+
+      Hashtbl *htbl = hashtbl_new(r);
+      Quad *q;
+
+      hashtbl_set_hash(htbl, hash_kind);
+      hashtbl_set_symmetry(htbl, symmetry);
+      hashtbl_set_compaction(htbl, compaction);
+      hashtbl_set_progress(htbl, prog);
+      hashtbl_set_perfctr(htbl, pc);
+
+      Trace *tr = NULL;
+
+      if ( trace_file )
+      {
+        FILE *tf = fopen(trace_file, "w");
+
+        if ( !tf )
+          perror(trace_file);
+        else
+          tr = trace_new(tf, trace_depth, trace_sample);
+      }
+
+      hashtbl_set_trace(htbl, tr);
+
+      progress_phase(prog, "condense");
+
+      if ( rle )
+      {
         q = rle_to_quad(htbl, rle);
 
         printf("...\n");
@@ -59,8 +202,6 @@ int main(int argc, char *argv[])
       }
       else
       {
-        Prgrph p = read_prgrph(file);
-
         q = prgrph_to_quad(htbl, p);
 
         //write_prgrph(stdout, p);
@@ -68,12 +209,42 @@ int main(int argc, char *argv[])
       }
 
       fclose(file);
-      test_quad(htbl, q, t, h);
+
+      if ( op_file )
+        q = quad_op(htbl, op, q, read_operand(htbl, op_file));
+
+      test_quad(htbl, prog, q, t, h, engine, prune, jumps, n_jumps);
 
       hashtbl_stat(htbl);
 
-      bi_free(t);
-      free_hashtbl(htbl);
+      if ( analyze )
+        hashtbl_analyze(htbl, stderr);
+
+      if ( stats_file )
+        write_stats(htbl, stats_file);
+
+      if ( tr )
+        trace_free(tr);
+
+      progress_phase(prog, "teardown");
+
+      // The memory is left to the system on a fast exit
+      if ( !fast_exit )
+      {
+        bi_free(t);
+
+        for ( i = 0 ; i < n_jumps ; i++ )
+          bi_free(jumps[i]);
+
+        free_hashtbl(htbl);
+      }
+
+      progress_phase(prog, NULL);
+      progress_summary(prog);
+      progress_free(prog);
+
+      if ( pc )
+        perfctr_free(pc);
 
       break;
     case 1:
@@ -81,7 +252,11 @@ int main(int argc, char *argv[])
       bi_test();
 #endif
     default:
-      printf("usage: %s (filename) (t:integer) [h:integer]\n", argv[0]);
+      printf("usage: %s [-s stats.json] [-p seconds] "
+             "[-T trace.json [-m min_depth] [-r sample]] [-P sample] "
+             "[-H legacy|mulxor|wyhash] [-E hashlife|sparse|auto] "
+             "[-J gen]... [-O op:file] [-A] [-F] [-S] [-G] [-C] "
+             "(filename) (t:integer) [h:integer]\n", argv[0]);
   }
 
   return 0;
@@ -94,12 +269,82 @@ const char *get_filename_ext(const char *filename)
   return dot + 1;
 }
 
+// Prefix of name up to ':', -1 if unknown
+int op_by_name(const char *name)
+{
+  const char *names[] = {"or", "and", "xor", "andnot"};
+  const int ops[] = {OP_OR, OP_AND, OP_XOR, OP_ANDNOT};
+  const size_t len = strcspn(name, ":");
+
+  int i;
+  for ( i = 0 ; i < 4 ; i++ )
+    if ( strlen(names[i]) == len && strncmp(name, names[i], len) == 0 )
+      return ops[i];
+
+  return -1;
+}
+
+// Second operand of -O, its rule is that of htbl
+Quad *read_operand(Hashtbl *htbl, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  Quad *q;
+
+  if ( !file )
+  {
+    perror(path);
+    exit(1);
+  }
+
+  if ( strcmp(get_filename_ext(path), "rle") == 0 )
+  {
+    Rle *rle = read_rle(file);
+
+    q = rle_to_quad(htbl, rle);
+    free_rle(rle);
+  }
+  else
+  {
+    Prgrph p = read_prgrph(file);
+
+    q = prgrph_to_quad(htbl, p);
+    free_prgrph(p);
+  }
+
+  fclose(file);
+
+  return q;
+}
+
 const char *collect_arg3(char *argv, BigInt **t)
 {
   return NULL;
 }
 
-void test_quad(Hashtbl *htbl, Quad *q, BigInt *t, int h)
+void write_stats(Hashtbl *htbl, const char *path)
+{
+  FILE *file = fopen(path, "w");
+
+  if ( !file )
+  {
+    perror(path);
+    return;
+  }
+
+  hashtbl_stats_json(htbl, file);
+  fclose(file);
+}
+
+void test_quad(
+  Hashtbl *htbl,
+  Progress *prog,
+  Quad *q,
+  BigInt *t,
+  int h,
+  int engine,
+  int prune,
+  BigInt **jumps,
+  int n_jumps)
 {
   const int m = 32, n = 80;
   //print_quad(q);
@@ -111,11 +356,75 @@ void test_quad(Hashtbl *htbl, Quad *q, BigInt *t, int h)
 #else
   int shift_e;
 
-  q = destiny(htbl, q, t, &shift_e);
+  if ( engine == ENGINE_SPARSE )
+  {
+    if ( bi_log2(t) >= 31 )
+    {
+      fprintf(stderr, "too many generations for the sparse engine\n");
+      exit(1);
+    }
+
+    progress_phase(prog, "sparse");
+
+    Smap *s = slowlife(hashtbl_kernel(htbl), quad_to_smap(htbl, q, 0, 0),
+      bi_to_int(t));
+
+    if ( !s )
+    {
+      perror("slowlife()");
+      exit(1);
+    }
+
+    // In the frame of destiny()
+    q = smap_to_quad(htbl, s, h, &shift_e);
+    freesmp(s);
+  }
+  else if ( engine == ENGINE_AUTO )
+  {
+    progress_phase(prog, "adaptive");
+    q = adaptive_destiny(htbl, q, t, h, &shift_e, stderr);
+  }
+  else if ( prune || n_jumps )
+  {
+    progress_phase(prog, "destiny");
+
+    Sim *sim = sim_new(htbl, q);
+    int i;
+
+    if ( prune && !sim_set_pruning(sim, 1) )
+    {
+      fprintf(stderr, "spaceships are only pruned with Conway's rule\n");
+      exit(1);
+    }
+
+    for ( i = 0 ; i < n_jumps ; i++ )
+      sim_goto(sim, jumps[i]);
+
+    sim_goto(sim, t);
+
+    if ( prune )
+    {
+      const Escape *es = sim_escape(sim);
+
+      fprintf(stderr, "%ld escaped ships, root of depth %d\n",
+              escape_ships(es), sim_current(sim)->root->depth);
+      escape_print(stderr, es);
+    }
+
+    q = sim_whole(sim, h, &shift_e);
+    sim_free(sim);
+  }
+  else
+  {
+    progress_phase(prog, "destiny");
+    q = destiny(htbl, q, t, &shift_e);
+  }
+
+  progress_phase(prog, "render");
 
   BigInt *bi_l = bi_power_2(shift_e - h);
 
-  UMatrix um = quad_to_matrix(bi_l, bi_l, m, n, h, q); 
+  UMatrix um = quad_to_matrix(htbl, bi_l, bi_l, m, n, h, q); 
   bi_free(bi_l);
 #endif
 
@@ -0,0 +1,598 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "definitions.h"
+#include "bigint.h"
+#include "hashtbl.h"
+#include "hashlife.h"
+#include "lifecount.h"
+#include "conversion.h"
+#include "prgrph.h"
+#include "simulation.h"
+#include "soup.h"
+#include "rulelut.h"
+#include "sparsemap.h"
+#include "slowlife.h"
+
+/* Microbenchmarks of the hot paths of the engine.
+ *
+ * Each benchmark runs a number of repetitions of a fixed count of
+ * operations, after some warmup repetitions. Setup code (building trees,
+ * drawing keys) is not timed. The median and the 10th/90th percentiles
+ * of the time per operation are reported, with cycles per operation
+ * from the time stamp counter when there is one. */
+
+#define KEYS_LEN 4096
+#define BI_LEN 256
+
+struct Fixture
+{
+  Hashtbl  *htbl;
+  uint32_t  rand;
+  Quad     *gun;            // glider gun after 10^6 steps
+  Quad     *soup;           // rebuilt before each repetition when needed
+  Quad     *keys[KEYS_LEN][4];
+  int       keys_d;         // depth of the nodes built from keys
+  Quad_map *map;
+  Hashtbl  *hashers[HASH_KINDS]; // empty tables, one per hash function
+  BigInt   *bi[BI_LEN];
+  Soup     *lanes;          // 64 random soups in bit lanes
+  Smap     *sparse;         // a random soup for the sparse engine
+};
+
+struct Micro
+{
+  const char *name;
+  void (*setup)(struct Fixture *);
+  long (*run)(struct Fixture *, long n); // returns a checksum
+  long        ops;                      // operations per repetition
+};
+
+uint32_t fx_rand(struct Fixture *fx);
+Quad    *fx_soup(struct Fixture *fx, int side);
+Quad    *fx_node(struct Fixture *fx, int d);
+void     fx_keys_existing(struct Fixture *fx);
+void     fx_keys_new(struct Fixture *fx);
+void     fx_nodes_d2(struct Fixture *fx);
+
+void setup_none(struct Fixture *fx);
+void setup_map(struct Fixture *fx);
+void setup_bi(struct Fixture *fx);
+void setup_soup(struct Fixture *fx);
+void setup_soup_once(struct Fixture *fx);
+void setup_lanes(struct Fixture *fx);
+void setup_sparse(struct Fixture *fx);
+
+long run_cons_hit(struct Fixture *fx, long n);
+long run_cons_miss(struct Fixture *fx, long n);
+long run_cons_batch(struct Fixture *fx, long n);
+long run_hash(struct Fixture *fx, long n, int kind);
+long run_hash_legacy(struct Fixture *fx, long n);
+long run_hash_mulxor(struct Fixture *fx, long n);
+long run_hash_wy(struct Fixture *fx, long n);
+long run_map_assoc(struct Fixture *fx, long n);
+long run_map_add(struct Fixture *fx, long n);
+long run_center(struct Fixture *fx, long n);
+long run_expand(struct Fixture *fx, long n);
+long run_step_d2(struct Fixture *fx, long n);
+long run_bi_add(struct Fixture *fx, long n);
+long run_cell_count(struct Fixture *fx, long n);
+long run_quad_to_matrix(struct Fixture *fx, long n);
+long run_lanes(struct Fixture *fx, long n);
+long run_sparse(struct Fixture *fx, long n);
+
+const struct Micro micros[] = {
+  {"cons_quad_hit",  fx_keys_existing, run_cons_hit,       KEYS_LEN},
+  {"cons_quad_miss", fx_keys_new,      run_cons_miss,      KEYS_LEN},
+  {"cons_quads_hit", fx_keys_existing, run_cons_batch,     KEYS_LEN},
+  {"hash_legacy",    fx_keys_existing, run_hash_legacy,    KEYS_LEN},
+  {"hash_mulxor",    fx_keys_existing, run_hash_mulxor,    KEYS_LEN},
+  {"hash_wyhash",    fx_keys_existing, run_hash_wy,        KEYS_LEN},
+  {"map_assoc",      setup_map,        run_map_assoc,      KEYS_LEN},
+  {"map_add",        setup_none,       run_map_add,        KEYS_LEN},
+  {"center",         fx_keys_existing, run_center,         KEYS_LEN},
+  {"expand",         fx_keys_existing, run_expand,         KEYS_LEN},
+  {"step_d2",        fx_nodes_d2,      run_step_d2,        KEYS_LEN},
+  {"bi_add",         setup_bi,         run_bi_add,         BI_LEN},
+  {"cell_count",     setup_soup,       run_cell_count,     1},
+  {"cell_count_hot", setup_soup_once,  run_cell_count,     1024},
+  {"quad_to_matrix", setup_none,       run_quad_to_matrix, 16},
+  {"soup_lanes_gen", setup_lanes,      run_lanes,          64},
+  {"sparse_gen",     setup_sparse,     run_sparse,         64},
+};
+
+const int micros_c = sizeof(micros) / sizeof(struct Micro);
+
+uint64_t cycles(void);
+int      cmp_double(const void *a, const void *b);
+
+/**************************************************/
+
+int main(int argc, char *argv[])
+{
+  const char *filter = NULL;
+  int reps = 21, warmup = 3, opt;
+
+  while ( (opt = getopt(argc, argv, "n:w:f:")) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'n': reps = atoi(optarg); break;
+      case 'w': warmup = atoi(optarg); break;
+      case 'f': filter = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-n repetitions] [-w warmup] "
+                        "[-f filter]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if ( reps < 1 )
+    reps = 1;
+
+  struct Fixture fx;
+  int i, r;
+
+  fx.htbl = hashtbl_new(6152);
+  fx.rand = 2463534242u;
+  fx.map  = NULL;
+  fx.lanes = NULL;
+  fx.sparse = NULL;
+  memset(fx.bi, 0, sizeof(fx.bi));
+
+  for ( i = 0 ; i < HASH_KINDS ; i++ )
+  {
+    fx.hashers[i] = hashtbl_new(6152);
+    hashtbl_set_hash(fx.hashers[i], i);
+  }
+
+  // Representative tree: the glider gun, evolved
+  {
+    FILE *file = fopen("../patterns/glider_gun.txt", "r");
+    Prgrph p = read_prgrph(file);
+
+    if ( file )
+      fclose(file);
+
+    if ( p.m < 0 )
+    {
+      fprintf(stderr, "microbench: cannot read ../patterns/glider_gun.txt\n");
+      return 1;
+    }
+
+    Quad *q = prgrph_to_quad(fx.htbl, p);
+    free_prgrph(p);
+
+    BigInt *t = bi_from_string("1000000", 10);
+    int shift_e;
+
+    fx.gun = destiny(fx.htbl, q, t, &shift_e);
+    bi_free(t);
+  }
+
+  fx.soup = fx_soup(&fx, 64);
+
+  double *ns  = malloc(reps * sizeof(double)),
+         *cyc = malloc(reps * sizeof(double));
+
+  if ( !ns || !cyc )
+  {
+    perror("main()");
+    exit(1);
+  }
+
+  printf("%-16s %8s %12s %12s %12s %12s\n",
+         "benchmark", "ops", "median_ns", "p10_ns", "p90_ns", "median_cyc");
+
+  long checksum = 0;
+
+  for ( i = 0 ; i < micros_c ; i++ )
+  {
+    const struct Micro *m = &micros[i];
+
+    if ( filter && !strstr(m->name, filter) )
+      continue;
+
+    for ( r = -warmup ; r < reps ; r++ )
+    {
+      m->setup(&fx);
+
+      double   t0 = stats_now() * 1e9;
+      uint64_t c0 = cycles();
+
+      checksum += m->run(&fx, m->ops);
+
+      uint64_t c1 = cycles();
+      double   t1 = stats_now() * 1e9;
+
+      if ( r >= 0 )
+      {
+        ns[r]  = (t1 - t0) / m->ops;
+        cyc[r] = (double) (c1 - c0) / m->ops;
+      }
+    }
+
+    qsort(ns, reps, sizeof(double), cmp_double);
+    qsort(cyc, reps, sizeof(double), cmp_double);
+
+    printf("%-16s %8ld %12.2f %12.2f %12.2f %12.1f\n",
+           m->name, m->ops, ns[reps / 2], ns[reps / 10],
+           ns[reps - 1 - reps / 10], cyc[reps / 2]);
+  }
+
+  // Keeps the computations from being optimized away
+  fprintf(stderr, "checksum %ld\n", checksum);
+
+  for ( i = 0 ; i < BI_LEN ; i++ )
+    if ( fx.bi[i] )
+      bi_free(fx.bi[i]);
+
+  if ( fx.lanes )
+    soup_free(fx.lanes);
+
+  if ( fx.sparse )
+    freesmp(fx.sparse);
+
+  free(ns);
+  free(cyc);
+  free_hashtbl(fx.htbl);
+
+  for ( i = 0 ; i < HASH_KINDS ; i++ )
+    free_hashtbl(fx.hashers[i]);
+
+  return 0;
+}
+
+/*** Fixtures ***/
+
+uint32_t fx_rand(struct Fixture *fx)
+{
+  // xorshift32
+  fx->rand ^= fx->rand << 13;
+  fx->rand ^= fx->rand >> 17;
+  fx->rand ^= fx->rand << 5;
+  return fx->rand;
+}
+
+Quad *fx_soup(struct Fixture *fx, int side)
+{
+  Prgrph p;
+
+  p.prgrph = alloc_prgrph(side, side, sizeof(char));
+  p.m = side;
+
+  if ( !p.prgrph )
+  {
+    perror("fx_soup()");
+    exit(1);
+  }
+
+  int i, j;
+  for ( i = 0 ; i < side ; i++ )
+    for ( j = 0 ; j < side ; j++ )
+      p.prgrph[i][j] = fx_rand(fx) >> 31 ? ALIVE : DEAD;
+
+  Quad *q = prgrph_to_quad(fx->htbl, p);
+  free_prgrph(p);
+
+  return q;
+}
+
+// A random node of depth d from the evolved glider gun
+Quad *fx_node(struct Fixture *fx, int d)
+{
+  Quad *q = fx->gun;
+
+  while ( q->depth > d )
+    q = q->node.n.sub[fx_rand(fx) & 3];
+
+  return q;
+}
+
+// Subtrees of existing nodes, from the evolved glider gun
+void fx_keys_existing(struct Fixture *fx)
+{
+  int i, k;
+
+  fx->keys_d = 4;
+
+  for ( i = 0 ; i < KEYS_LEN ; i++ )
+  {
+    Quad *q = fx_node(fx, fx->keys_d);
+
+    for ( k = 0 ; k < 4 ; k++ )
+      fx->keys[i][k] = q->node.n.sub[k];
+  }
+}
+
+// Random combinations of depth 1 nodes, almost never built before
+void fx_keys_new(struct Fixture *fx)
+{
+  int i, k;
+
+  fx->keys_d = 2;
+
+  for ( i = 0 ; i < KEYS_LEN ; i++ )
+    for ( k = 0 ; k < 4 ; k++ )
+    {
+      Quad *quad[4];
+      int j;
+
+      for ( j = 0 ; j < 4 ; j++ )
+        quad[j] = leaf(fx_rand(fx) & 15);
+
+      fx->keys[i][k] = cons_quad(fx->htbl, quad, 1);
+    }
+}
+
+// Depth 2 nodes of the evolved glider gun, in keys[i][0]
+void fx_nodes_d2(struct Fixture *fx)
+{
+  int i;
+
+  fx->keys_d = 2;
+
+  for ( i = 0 ; i < KEYS_LEN ; i++ )
+    fx->keys[i][0] = fx_node(fx, fx->keys_d);
+}
+
+void setup_none(struct Fixture *fx)
+{
+  (void) fx;
+}
+
+// One list of 8 memoized results, as fate() builds
+void setup_map(struct Fixture *fx)
+{
+  if ( !fx->map )
+  {
+    int k;
+    for ( k = 0 ; k < 8 ; k++ )
+      fx->map = map_add(fx->htbl, fx->map, k, leaf(k));
+  }
+}
+
+void setup_bi(struct Fixture *fx)
+{
+  // Operands of 1 to 4 words, built once
+  if ( !fx->bi[0] )
+  {
+    int i;
+    for ( i = 0 ; i < BI_LEN ; i++ )
+    {
+      BigInt *b = bi_power_2(fx_rand(fx) % 124);
+      fx->bi[i] = bi_plus_int(b, fx_rand(fx) >> 1);
+      bi_free(b);
+    }
+  }
+}
+
+void setup_soup(struct Fixture *fx)
+{
+  // Fresh nodes, whose populations are not computed yet
+  fx->soup = fx_soup(fx, 64);
+}
+
+// Populations already computed
+void setup_soup_once(struct Fixture *fx)
+{
+  cell_count(fx->htbl, fx->soup);
+}
+
+// Fresh 16x16 soups in the 64 lanes
+void setup_lanes(struct Fixture *fx)
+{
+  int l;
+
+  if ( !fx->lanes )
+    fx->lanes = soup_new(6152, 16, 24);
+
+  soup_clear(fx->lanes);
+
+  for ( l = 0 ; l < SOUP_LANES ; l++ )
+    soup_seed(fx->lanes, l, fx_rand(fx));
+}
+
+// A fresh 64x64 soup as a sparse map
+void setup_sparse(struct Fixture *fx)
+{
+  if ( fx->sparse )
+    freesmp(fx->sparse);
+
+  fx->sparse = quad_to_smap(fx->htbl, fx_soup(fx, 64), 0, 0);
+}
+
+/*** Benchmarks ***/
+
+long run_cons_hit(struct Fixture *fx, long n)
+{
+  long i, acc = 0;
+  for ( i = 0 ; i < n ; i++ )
+    acc += (intptr_t) cons_quad(fx->htbl, fx->keys[i], fx->keys_d);
+  return acc;
+}
+
+long run_cons_miss(struct Fixture *fx, long n)
+{
+  return run_cons_hit(fx, n);
+}
+
+// By batches of 9, as in fate()
+long run_cons_batch(struct Fixture *fx, long n)
+{
+  long i, acc = 0;
+  for ( i = 0 ; i + 9 <= n ; i += 9 )
+  {
+    Quad *res[9];
+    cons_quads(fx->htbl, fx->keys + i, 9, fx->keys_d, res);
+    acc += (intptr_t) res[8];
+  }
+  return acc;
+}
+
+// hashtbl_index() as cons_quad() calls it, in a table of the given kind
+long run_hash(struct Fixture *fx, long n, int kind)
+{
+  Hashtbl *htbl = fx->hashers[kind];
+
+  long i, acc = 0;
+  for ( i = 0 ; i < n ; i++ )
+    acc += hashtbl_index(htbl, fx->keys[i]);
+  return acc;
+}
+
+long run_hash_legacy(struct Fixture *fx, long n)
+{
+  return run_hash(fx, n, HASH_LEGACY);
+}
+
+long run_hash_mulxor(struct Fixture *fx, long n)
+{
+  return run_hash(fx, n, HASH_MULXOR);
+}
+
+long run_hash_wy(struct Fixture *fx, long n)
+{
+  return run_hash(fx, n, HASH_WY);
+}
+
+long run_map_assoc(struct Fixture *fx, long n)
+{
+  long i, acc = 0;
+  for ( i = 0 ; i < n ; i++ )
+    acc += (intptr_t) map_assoc(fx->map, i & 7);
+  return acc;
+}
+
+long run_map_add(struct Fixture *fx, long n)
+{
+  Quad_map *map = NULL;
+
+  long i;
+  for ( i = 0 ; i < n ; i++ )
+  {
+    // Lists of the length built by fate()
+    if ( !(i & 7) )
+      map = NULL;
+    map = map_add(fx->htbl, map, 7 - (i & 7), leaf(i & 15));
+  }
+  return (intptr_t) map;
+}
+
+long run_center(struct Fixture *fx, long n)
+{
+  long i, acc = 0;
+  for ( i = 0 ; i < n ; i++ )
+  {
+    Quad *quad[4];
+    memcpy(quad, fx->keys[i], sizeof(quad));
+    acc += (intptr_t) center(fx->htbl, quad, fx->keys_d - 1);
+  }
+  return acc;
+}
+
+long run_expand(struct Fixture *fx, long n)
+{
+  long i, acc = 0;
+  for ( i = 0 ; i < n ; i++ )
+    acc += (intptr_t) expand(fx->htbl, fx->keys[i][i & 3], fx->keys_d);
+  return acc;
+}
+
+// By batches of 9, as in fate()
+long run_step_d2(struct Fixture *fx, long n)
+{
+  long i, j, acc = 0;
+  for ( i = 0 ; i + 9 <= n ; i += 9 )
+  {
+    Quad *q[9], *res[9];
+    for ( j = 0 ; j < 9 ; j++ )
+      q[j] = fx->keys[i + j][0];
+    step_d2(fx->htbl, q, 9, i & 1, res);
+    acc += (intptr_t) res[8];
+  }
+  return acc;
+}
+
+// A generation of the 64 lanes
+long run_lanes(struct Fixture *fx, long n)
+{
+  return soup_run(fx->lanes, n) + soup_population(fx->lanes, 0);
+}
+
+// A generation of the soup in the sparse engine
+long run_sparse(struct Fixture *fx, long n)
+{
+  const Rule_kernel *k = rule_lut_kernel(rule_lut(6152));
+
+  fx->sparse = slowlife(k, fx->sparse, n);
+
+  if ( !fx->sparse )
+  {
+    perror("run_sparse()");
+    exit(1);
+  }
+
+  return smp_population(fx->sparse);
+}
+
+long run_bi_add(struct Fixture *fx, long n)
+{
+  long i, acc = 0;
+  for ( i = 0 ; i < n ; i++ )
+  {
+    BigInt *s = bi_add(fx->bi[i], fx->bi[(i + 1) % BI_LEN]);
+    acc += bi_log2(s);
+    bi_free(s);
+  }
+  return acc;
+}
+
+long run_cell_count(struct Fixture *fx, long n)
+{
+  long i, acc = 0;
+  for ( i = 0 ; i < n ; i++ )
+    acc += bi_to_int(cell_count(fx->htbl, fx->soup));
+  return acc;
+}
+
+long run_quad_to_matrix(struct Fixture *fx, long n)
+{
+  const int m = 32, w = 80;
+  BigInt *z = bi_zero();
+
+  long i, acc = 0;
+  for ( i = 0 ; i < n ; i++ )
+  {
+    UMatrix um = quad_to_matrix(fx->htbl, z, z, m, w, 0, fx->gun);
+    acc += um.um_char[i % m][i % w];
+    free_um_char(um, m);
+  }
+
+  bi_free(z);
+  return acc;
+}
+
+/*** Timers ***/
+
+// Falls back on nanoseconds without a time stamp counter
+uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return (uint64_t) (stats_now() * 1e9);
+#endif
+}
+
+int cmp_double(const void *a, const void *b)
+{
+  const double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
@@ -59,14 +59,20 @@ rule parse_rule(char *buff)
 
 #ifdef DEBUG
 
+#include "runlength.h"
+
 void test_rle_token(char *filename)
 {
   FILE *file;
   if ( (file = fopen(filename, "r")) == NULL )
     return;
 
+  Rle_reader r;
   char tag;
-  int len = rle_token(file, &tag);
+
+  rle_reader_init(&r, file);
+
+  int len = rle_token(&r, &tag);
 
   while ( len )
   {
@@ -76,7 +82,7 @@ void test_rle_token(char *filename)
       return;
     }
     printf("%d%c\n", len, tag);
-    len = rle_token(NULL, &tag);
+    len = rle_token(&r, &tag);
   }
 
   printf("!\n");
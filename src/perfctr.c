@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "stats.h"
+#include "perfctr.h"
+
+struct Perfctr
+{
+  int      leader;              // group file descriptor, -1 if none
+  int      fd[PERF_EVENTS];     // -1 when unavailable
+  int      pos[PERF_EVENTS];    // position in the group read
+  int      len;                 // counters in the group
+  int      error;               // errno of the first failure
+
+  int      sample;
+  long     calls[STATS_DEPTH];
+  long     windows[STATS_DEPTH];
+  uint64_t begin[STATS_DEPTH][PERF_EVENTS];
+  uint64_t sum[STATS_DEPTH][PERF_EVENTS];
+};
+
+const char *perf_names[PERF_EVENTS] = {
+  "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses"
+};
+
+int perf_open(struct Perfctr *pc, int e);
+
+/**************************************************/
+
+Perfctr *perfctr_new(int sample)
+{
+  Perfctr *pc = calloc(1, sizeof(Perfctr));
+
+  if ( !pc )
+  {
+    perror("perfctr_new()");
+    exit(1);
+  }
+
+  pc->leader = -1;
+  pc->sample = sample;
+
+  int e;
+  for ( e = 0 ; e < PERF_EVENTS ; e++ )
+    pc->fd[e] = perf_open(pc, e);
+
+#ifdef __linux__
+  if ( pc->leader >= 0 )
+  {
+    ioctl(pc->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(pc->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+
+  return pc;
+}
+
+void perfctr_free(Perfctr *pc)
+{
+  int e;
+  for ( e = 0 ; e < PERF_EVENTS ; e++ )
+    if ( pc->fd[e] >= 0 )
+      close(pc->fd[e]);
+
+  free(pc);
+}
+
+int perfctr_available(Perfctr *pc)
+{
+  int e, mask = 0;
+  for ( e = 0 ; e < PERF_EVENTS ; e++ )
+    if ( pc->fd[e] >= 0 )
+      mask |= 1 << e;
+
+  return mask;
+}
+
+void perfctr_read(Perfctr *pc, uint64_t v[PERF_EVENTS])
+{
+  memset(v, 0, PERF_EVENTS * sizeof(uint64_t));
+
+  if ( pc->leader < 0 )
+    return;
+
+  // nr, time enabled, time running, values
+  uint64_t buf[3 + PERF_EVENTS];
+
+  if ( read(pc->leader, buf, sizeof(buf)) < (ssize_t) (3 * sizeof(uint64_t)) )
+    return;
+
+  // Scaled when the counters were multiplexed
+  const double scale = buf[2] ? (double) buf[1] / buf[2] : 1;
+
+  int e;
+  for ( e = 0 ; e < PERF_EVENTS ; e++ )
+    if ( pc->fd[e] >= 0 )
+      v[e] = (uint64_t) (buf[3 + pc->pos[e]] * scale);
+}
+
+void perfctr_print(Perfctr *pc, FILE *out, const uint64_t begin[PERF_EVENTS],
+                   const uint64_t end[PERF_EVENTS])
+{
+  if ( pc->leader < 0 )
+  {
+    fprintf(out, " (perf counters unavailable: %s)", strerror(pc->error));
+    return;
+  }
+
+  uint64_t d[PERF_EVENTS];
+
+  int e;
+  for ( e = 0 ; e < PERF_EVENTS ; e++ )
+    d[e] = end[e] - begin[e];
+
+  if ( pc->fd[PERF_CYCLES] >= 0 && pc->fd[PERF_INSTRUCTIONS] >= 0 )
+    fprintf(out, " ipc %5.2f", d[PERF_CYCLES]
+                 ? (double) d[PERF_INSTRUCTIONS] / d[PERF_CYCLES] : 0.);
+
+  // per thousand instructions
+  for ( e = PERF_LLC_MISSES ; e < PERF_EVENTS ; e++ )
+  {
+    if ( pc->fd[e] < 0 )
+      fprintf(out, " %s n/a", perf_names[e]);
+    else if ( pc->fd[PERF_INSTRUCTIONS] >= 0 && d[PERF_INSTRUCTIONS] )
+      fprintf(out, " %s %.2f/ki", perf_names[e],
+              1000. * d[e] / d[PERF_INSTRUCTIONS]);
+    else
+      fprintf(out, " %s %llu", perf_names[e], (unsigned long long) d[e]);
+  }
+}
+
+int perfctr_window_begin(Perfctr *pc, int d)
+{
+  const int s = stats_slot(d);
+
+  if ( !pc->sample || pc->leader < 0 || pc->calls[s]++ % pc->sample )
+    return 0;
+
+  perfctr_read(pc, pc->begin[s]);
+  return 1;
+}
+
+void perfctr_window_end(Perfctr *pc, int d)
+{
+  const int s = stats_slot(d);
+  uint64_t end[PERF_EVENTS];
+
+  perfctr_read(pc, end);
+
+  int e;
+  for ( e = 0 ; e < PERF_EVENTS ; e++ )
+    pc->sum[s][e] += end[e] - pc->begin[s][e];
+
+  pc->windows[s]++;
+}
+
+void perfctr_report(Perfctr *pc, FILE *out)
+{
+  const uint64_t zero[PERF_EVENTS] = {0};
+
+  int d;
+  for ( d = 0 ; d < STATS_DEPTH ; d++ )
+  {
+    if ( !pc->windows[d] )
+      continue;
+
+    fprintf(out, "fate depth %3d %8ld windows %12.0f cycles/call",
+            d, pc->windows[d], (double) pc->sum[d][PERF_CYCLES] / pc->windows[d]);
+    perfctr_print(pc, out, zero, pc->sum[d]);
+    fprintf(out, "\n");
+  }
+}
+
+/*** Auxiliary functions ***/
+
+// Adds the counter e to the group, returns its file descriptor or -1
+int perf_open(struct Perfctr *pc, int e)
+{
+#ifdef __linux__
+  const uint64_t config[PERF_EVENTS][2] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+                         | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+  };
+
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = config[e][0];
+  attr.config         = config[e][1];
+  attr.disabled       = pc->leader < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                      | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  int fd = syscall(SYS_perf_event_open, &attr, 0, -1, pc->leader, 0);
+
+  if ( fd < 0 )
+  {
+    if ( !pc->error )
+      pc->error = errno;
+    return -1;
+  }
+
+  if ( pc->leader < 0 )
+    pc->leader = fd;
+
+  pc->pos[e] = pc->len++;
+  return fd;
+#else
+  (void) e;
+  pc->error = ENOSYS;
+  return -1;
+#endif
+}
@@ -0,0 +1,52 @@
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Hardware performance counters (Linux perf_event_open).
+ *
+ * The counters which cannot be opened (other systems, containers,
+ * perf_event_paranoid...) read as zero and are reported as unavailable,
+ * everything else works the same.
+ *
+ * Besides the phases (see progress_set_perfctr()), windows around fate()
+ * calls are measured: one call out of sample at each depth, their counts
+ * being summed per depth. A read costs a system call, individual
+ * cons_quad() calls are too short to be measured this way: their cost
+ * shows in the windows of the lowest depths. */
+
+enum Perf_event
+{
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_EVENTS
+};
+
+typedef struct Perfctr Perfctr;
+
+// sample == 0: no fate() windows
+Perfctr *perfctr_new(int sample);
+void     perfctr_free(Perfctr *pc);
+
+// Bit i set if the counter i is available
+int      perfctr_available(Perfctr *pc);
+
+// Counts since perfctr_new()
+void     perfctr_read(Perfctr *pc, uint64_t v[PERF_EVENTS]);
+
+// IPC and misses per thousand instructions of the counts end - begin
+void     perfctr_print(Perfctr *pc, FILE *out, const uint64_t begin[PERF_EVENTS],
+                       const uint64_t end[PERF_EVENTS]);
+
+// Windows around fate() calls on nodes of depth d,
+// perfctr_window_end() is called iff perfctr_window_begin() returned 1
+int      perfctr_window_begin(Perfctr *pc, int d);
+void     perfctr_window_end(Perfctr *pc, int d);
+// Counts of the windows, per depth
+void     perfctr_report(Perfctr *pc, FILE *out);
+
+#endif
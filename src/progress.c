@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "hashtbl.h"
+#include "perfctr.h"
+#include "progress.h"
+
+#define PHASE_MAX 16
+#define LEVELS 16 // below the root, used to estimate the progress of a step
+
+struct Phase
+{
+  const char *name;
+  double      time; // seconds
+  uint64_t    begin[PERF_EVENTS], end[PERF_EVENTS];
+};
+
+struct Progress
+{
+  FILE        *out;
+  double       interval;
+  double       start;       // of the run
+  double       phase_start;
+  int          phase_len;
+  struct Phase phase[PHASE_MAX];
+  Perfctr     *perfctr;
+
+  // Current step of destiny(), bits == 0 when not evolving
+  int          bit, bits, t;
+  int          depth;
+  double       step_start;
+  int          done[LEVELS]; // done[k]: fate() calls of depth depth-1-k
+                             // completed since the end of their parent
+};
+
+long   rss_kb(void);
+long   peak_rss_kb(void);
+double step_fraction(const Progress *p);
+void   progress_line(Progress *p, Hashtbl *htbl);
+void   on_signal(int sig);
+
+/* Set by the signal handlers, cleared by progress_fate() */
+static volatile sig_atomic_t report_pending = 0;
+static volatile sig_atomic_t dump_pending   = 0;
+
+/**************************************************/
+
+Progress *progress_new(FILE *out, double interval)
+{
+  Progress *p = malloc(sizeof(Progress));
+
+  if ( !p )
+  {
+    perror("progress_new()");
+    exit(1);
+  }
+
+  p->out         = out;
+  p->interval    = interval;
+  p->start       = stats_now();
+  p->phase_start = p->start;
+  p->phase_len   = 0;
+  p->bits        = 0;
+  p->depth       = 0;
+  p->perfctr     = NULL;
+
+  struct sigaction sa;
+
+  sa.sa_handler = on_signal;
+  sa.sa_flags   = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+
+  sigaction(SIGUSR1, &sa, NULL);
+
+  if ( interval > 0 )
+  {
+    struct itimerval it;
+
+    it.it_interval.tv_sec  = (long) interval;
+    it.it_interval.tv_usec = (long) ((interval - (long) interval) * 1e6);
+    it.it_value = it.it_interval;
+
+    sigaction(SIGALRM, &sa, NULL);
+    setitimer(ITIMER_REAL, &it, NULL);
+  }
+
+  return p;
+}
+
+void progress_free(Progress *p)
+{
+  if ( p->interval > 0 )
+  {
+    struct itimerval it = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_REAL, &it, NULL);
+    signal(SIGALRM, SIG_DFL);
+  }
+
+  signal(SIGUSR1, SIG_DFL);
+
+  free(p);
+}
+
+void progress_set_perfctr(Progress *p, Perfctr *pc)
+{
+  p->perfctr = pc;
+}
+
+void progress_phase(Progress *p, const char *name)
+{
+  const double t = stats_now();
+  uint64_t v[PERF_EVENTS] = {0};
+
+  if ( p->perfctr )
+    perfctr_read(p->perfctr, v);
+
+  if ( p->phase_len > 0 )
+  {
+    struct Phase *ph = &p->phase[p->phase_len-1];
+
+    ph->time = t - p->phase_start;
+    memcpy(ph->end, v, sizeof(v));
+  }
+
+  p->phase_start = t;
+  p->bits = 0;
+
+  if ( name && p->phase_len < PHASE_MAX )
+  {
+    struct Phase *ph = &p->phase[p->phase_len++];
+
+    ph->name = name;
+    ph->time = 0;
+    memcpy(ph->begin, v, sizeof(v));
+    memcpy(ph->end, v, sizeof(v));
+  }
+}
+
+void progress_summary(Progress *p)
+{
+  int i;
+  for ( i = 0 ; i < p->phase_len ; i++ )
+  {
+    const struct Phase *ph = &p->phase[i];
+
+    fprintf(p->out, "phase %-10s %10.3f s", ph->name, ph->time);
+
+    if ( p->perfctr )
+      perfctr_print(p->perfctr, p->out, ph->begin, ph->end);
+
+    fprintf(p->out, "\n");
+  }
+
+  if ( p->perfctr )
+    perfctr_report(p->perfctr, p->out);
+
+  fprintf(p->out, "total            %10.3f s\n", stats_now() - p->start);
+  fprintf(p->out, "peak rss         %10ld KB\n", peak_rss_kb());
+  fflush(p->out);
+}
+
+void progress_step(Progress *p, Hashtbl *htbl, int bit, int bits, int d)
+{
+  p->bit        = bit;
+  p->bits       = bits;
+  p->t          = bit;
+  p->depth      = d;
+  p->step_start = stats_now();
+
+  int k;
+  for ( k = 0 ; k < LEVELS ; k++ )
+    p->done[k] = 0;
+
+  if ( report_pending || dump_pending )
+    progress_fate(p, htbl, -1, 0);
+}
+
+void progress_fate(Progress *p, Hashtbl *htbl, int d, int t)
+{
+  (void) t;
+
+  const int k = p->depth - 1 - d;
+
+  if ( 0 <= k && k < LEVELS )
+  {
+    p->done[k]++;
+
+    if ( k + 1 < LEVELS )
+      p->done[k+1] = 0;
+  }
+
+  if ( report_pending )
+  {
+    report_pending = 0;
+    progress_line(p, htbl);
+  }
+
+  if ( dump_pending )
+  {
+    dump_pending = 0;
+    progress_line(p, htbl);
+    hashtbl_stats_json(htbl, p->out);
+  }
+}
+
+/*** Auxiliary functions ***/
+
+void on_signal(int sig)
+{
+  if ( sig == SIGUSR1 )
+    dump_pending = 1;
+  else
+    report_pending = 1;
+}
+
+void progress_line(Progress *p, Hashtbl *htbl)
+{
+  const double t = stats_now();
+
+  fprintf(p->out, "[%9.1fs]", t - p->start);
+
+  if ( p->bits )
+  {
+    const double f = step_fraction(p);
+
+    fprintf(p->out, " bit %d/%d depth %d", p->bit, p->bits, p->depth);
+    fprintf(p->out, " nodes %d rss %ld KB", hashtbl_count(htbl), rss_kb());
+    fprintf(p->out, " step %3.0f%%", 100 * f);
+
+    if ( f > 0 )
+      fprintf(p->out, " eta %.1fs", (t - p->step_start) * (1 - f) / f);
+    else
+      fprintf(p->out, " eta ?");
+  }
+  else
+    fprintf(p->out, " nodes %d rss %ld KB", hashtbl_count(htbl), rss_kb());
+
+  fprintf(p->out, "\n");
+  fflush(p->out);
+}
+
+// Estimated from the calls completed below the root, as if all the calls
+// of a level took the same time. A node of depth d evolved by 2^t steps
+// makes 13 calls when d == t + 1 (by 2^(t-1) steps), and 4 otherwise.
+double step_fraction(const Progress *p)
+{
+  double f = 0, w = 1;
+  int d = p->depth, t = p->t, k;
+
+  for ( k = 0 ; k < LEVELS && d > 1 ; k++ )
+  {
+    const int n = d == t + 1 ? 13 : 4;
+
+    w /= n;
+    f += w * (p->done[k] < n ? p->done[k] : n);
+
+    if ( d == t + 1 )
+      t--;
+    d--;
+  }
+
+  return f < 1 ? f : 1;
+}
+
+// Resident memory, the peak one where /proc is not available
+long rss_kb(void)
+{
+  FILE *file = fopen("/proc/self/statm", "r");
+  long size, resident;
+
+  if ( !file )
+    return peak_rss_kb();
+
+  int ok = fscanf(file, "%ld %ld", &size, &resident) == 2;
+  fclose(file);
+
+  return ok ? resident * (sysconf(_SC_PAGESIZE) / 1024) : peak_rss_kb();
+}
+
+long peak_rss_kb(void)
+{
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+
+  return ru.ru_maxrss;
+}
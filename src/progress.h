@@ -0,0 +1,39 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdio.h>
+#include "hashtbl.h"
+#include "perfctr.h"
+
+/* Feedback on long runs.
+ *
+ * Phases (parsing, evolution, rendering...) are timed. While destiny()
+ * evolves an attached hashtable, a progress line is printed every
+ * interval seconds: the bit of t being processed, the root depth, the
+ * node count, the memory in use and an estimate of the time left for the
+ * current step. SIGUSR1 prints the same line followed by the hashtable
+ * stats (see hashtbl_stats_json()), without stopping the run.
+ *
+ * Signals are only polled from fate(), there should be a single Progress
+ * at a time. */
+
+typedef struct Progress Progress;
+
+// interval in seconds, 0 for reports on SIGUSR1 only
+Progress *progress_new(FILE *out, double interval);
+void      progress_free(Progress *p);
+
+// Ends the current phase and starts the next one, NULL to stop timing
+void      progress_phase(Progress *p, const char *name);
+// Hardware counters of the phases, and of the fate() windows, in the summary
+void      progress_set_perfctr(Progress *p, Perfctr *pc);
+// Durations of the phases and peak memory
+void      progress_summary(Progress *p);
+
+// Called by destiny() before evolving a root of depth d by 2^bit steps,
+// bits is the length of t
+void      progress_step(Progress *p, Hashtbl *htbl, int bit, int bits, int d);
+// Called by fate() after each call, polls the signals
+void      progress_fate(Progress *p, Hashtbl *htbl, int d, int t);
+
+#endif
@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "bigint.h"
+#include "hashtbl.h"
+#include "quadops.h"
+
+// Offsets of pull() are plain integers below this depth
+#define PULL_INT_DEPTH 30
+
+Quad *quad_op_(Hashtbl *htbl, int op, Quad *a, Quad *b);
+
+Quad *pull(Hashtbl *htbl, Quad *blk[4], const BigInt *x, const BigInt *y, int d);
+Quad *pull_(Hashtbl *htbl, Quad *blk[4], int x, int y, int d);
+Quad *place(Hashtbl *htbl, Quad *q, const BigInt *x, const BigInt *y, int d);
+
+int   leaf_bits(Quad *q);
+int   leaf_op(int op, int a, int b);
+
+void  sym_src(int s, int src[4]);
+Quad *quad_sym_(Hashtbl *htbl, Quad *q, int s, int create);
+
+// Cached result of quad_sym_find() for the images not in the table
+static Quad no_sym;
+
+/**************************************************/
+
+Quad *quad_pad(Hashtbl *htbl, Quad *q, int d)
+{
+  while ( q->depth < d )
+  {
+    Quad *ds = dead_space(htbl, q->depth);
+    Quad *quad[4] = {q, ds, ds, ds};
+
+    q = cons_quad(htbl, quad, q->depth + 1);
+  }
+
+  return q;
+}
+
+Quad *quad_op(Hashtbl *htbl, int op, Quad *a, Quad *b)
+{
+  if ( a->depth < b->depth )
+    a = quad_pad(htbl, a, b->depth);
+  else
+    b = quad_pad(htbl, b, a->depth);
+
+  return quad_op_(htbl, op, a, b);
+}
+
+int quad_is_dead(Hashtbl *htbl, Quad *q)
+{
+  return q == dead_space(htbl, q->depth);
+}
+
+/* The translation of q by (x, y) is done in two parts:
+ * - the low bits of x and y (below the width s of q) shift q inside
+ *   a tree B twice as wide, built with pull();
+ * - the high bits place the four quarters of B, which are aligned
+ *   on multiples of s, as paths of nodes with dead siblings. */
+
+Quad *quad_translate(
+  Hashtbl *htbl,
+  Quad *q,
+  const BigInt *x,
+  const BigInt *y,
+  int d)
+{
+  const int dq = q->depth;
+  const int d_ = d > dq ? d : dq + 1;
+
+  Quad *ds = dead_space(htbl, dq);
+  Quad *b[4];
+
+  int i, j;
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    Quad *blk[4] = {ds, ds, ds, ds};
+
+    blk[3 - i] = q;
+    b[i] = pull(htbl, blk, x, y, dq);
+  }
+
+  BigInt *s    = bi_power_2(dq + 1),
+         *x_[2] = {bi_copy(x), bi_add(x, s)},
+         *y_[2] = {bi_copy(y), bi_add(y, s)};
+
+  Quad *r = dead_space(htbl, d_);
+
+  for ( i = 0 ; i < 2 ; i++ )
+    for ( j = 0 ; j < 2 ; j++ )
+      if ( bi_log2(x_[j]) <= d_ + 1 && bi_log2(y_[i]) <= d_ + 1 )
+        r = quad_op_(htbl, OP_OR, r,
+                     place(htbl, b[2 * i + j], x_[j], y_[i], d_));
+
+  for ( i = 0 ; i < 2 ; i++ )
+  {
+    bi_free(x_[i]);
+    bi_free(y_[i]);
+  }
+  bi_free(s);
+
+  // Crop to the requested depth
+  while ( r->depth > d )
+    r = r->node.n.sub[0];
+
+  return r;
+}
+
+Quad *quad_paste(
+  Hashtbl *htbl,
+  Quad *dst,
+  Quad *src,
+  const BigInt *x,
+  const BigInt *y)
+{
+  BigInt *s = bi_power_2(src->depth + 1),
+         *x_end = bi_add(x, s),
+         *y_end = bi_add(y, s);
+
+  int d = dst->depth > src->depth ? dst->depth : src->depth;
+
+  if ( d < bi_log2(x_end) - 1 )
+    d = bi_log2(x_end) - 1;
+  if ( d < bi_log2(y_end) - 1 )
+    d = bi_log2(y_end) - 1;
+
+  bi_free(s);
+  bi_free(x_end);
+  bi_free(y_end);
+
+  return quad_op(htbl, OP_OR,
+                 quad_pad(htbl, dst, d),
+                 quad_translate(htbl, src, x, y, d));
+}
+
+Quad *quad_sym(Hashtbl *htbl, Quad *q, int s)
+{
+  return quad_sym_(htbl, q, s, 1);
+}
+
+Quad *quad_sym_find(Hashtbl *htbl, Quad *q, int s)
+{
+  return quad_sym_(htbl, q, s, 0);
+}
+
+/*** Auxiliary functions ***/
+
+// a and b have the same depth.
+// Identical or dead arguments are resolved without recursion,
+// so that the cost is proportional to the differing structure.
+Quad *quad_op_(Hashtbl *htbl, int op, Quad *a, Quad *b)
+{
+  const int d = a->depth;
+  Quad *ds = dead_space(htbl, d);
+
+  if ( a == b )
+    return op == OP_OR || op == OP_AND ? a : ds;
+  else if ( a == ds )
+    return op == OP_OR || op == OP_XOR ? b : ds;
+  else if ( b == ds )
+    return op == OP_AND ? ds : a;
+  else if ( d == 0 )
+    return leaf(leaf_op(op, leaf_bits(a), leaf_bits(b)));
+
+  // Commutative operations share their memo entries
+  if ( op != OP_ANDNOT && b < a )
+  {
+    Quad *c = a;
+    a = b;
+    b = c;
+  }
+
+  Quad *r = op_find(htbl, op, a, b);
+
+  if ( !r )
+  {
+    Quad *quad[4];
+
+    int i;
+    for ( i = 0 ; i < 4 ; i++ )
+      quad[i] = quad_op_(htbl, op, a->node.n.sub[i], b->node.n.sub[i]);
+
+    r = cons_quad(htbl, quad, d);
+
+    op_add(htbl, op, a, b, r);
+  }
+
+  return r;
+}
+
+/* blk is a 2x2 block of trees of depth d, with side 2s.
+ * Returns the tree of depth d whose top-left corner is at (s - x, s - y)
+ * in blk, where only the lowest d+1 bits of x and y are considered.
+ * In particular, when blk is q over dead cells, this is q shifted
+ * by (x, y). */
+Quad *pull(Hashtbl *htbl, Quad *blk[4], const BigInt *x, const BigInt *y, int d)
+{
+  if ( d < PULL_INT_DEPTH )
+  {
+    const int mask = (1 << (d + 1)) - 1;
+
+    return pull_(htbl, blk, bi_slice(x, 0) & mask, bi_slice(y, 0) & mask, d);
+  }
+
+  Quad *ds = dead_space(htbl, d);
+
+  if ( blk[0] == ds && blk[1] == ds && blk[2] == ds && blk[3] == ds )
+    return ds;
+
+  Quad *g[4][4], *quad[4];
+
+  int i, j;
+  for ( i = 0 ; i < 4 ; i++ )
+    for ( j = 0 ; j < 4 ; j++ )
+      g[i][j] = blk[(i & 2) + (j >> 1)]->node.n.sub[2 * (i & 1) + (j & 1)];
+
+  const int gi = !bi_digit(y, d), gj = !bi_digit(x, d);
+
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    Quad *sub[4];
+    int k;
+
+    for ( k = 0 ; k < 4 ; k++ )
+      sub[k] = g[gi + (i >> 1) + (k >> 1)][gj + (i & 1) + (k & 1)];
+
+    quad[i] = pull(htbl, sub, x, y, d - 1);
+  }
+
+  return cons_quad(htbl, quad, d);
+}
+
+Quad *pull_(Hashtbl *htbl, Quad *blk[4], int x, int y, int d)
+{
+  Quad *ds = dead_space(htbl, d);
+
+  if ( blk[0] == ds && blk[1] == ds && blk[2] == ds && blk[3] == ds )
+    return ds;
+  else if ( x == 0 && y == 0 )
+    return blk[3];
+  else if ( d == 0 )
+  {
+    int i, l = 0;
+    for ( i = 0 ; i < 4 ; i++ )
+    {
+      // cell of blk, out of 4x4
+      const int m = 2 - y + (i >> 1), n = 2 - x + (i & 1);
+
+      l |= blk[(m & 2) + (n >> 1)]->node.l.map[2 * (m & 1) + (n & 1)]
+           << (3 - i);
+    }
+
+    return leaf(l);
+  }
+
+  Quad *b = cons_quad(htbl, blk, d + 1);
+  Quad *r = op_find_at(htbl, OP_PULL, b, NULL, x, y);
+
+  if ( !r )
+  {
+    Quad *g[4][4], *quad[4];
+    const int h = 1 << d;
+
+    int i, j;
+    for ( i = 0 ; i < 4 ; i++ )
+      for ( j = 0 ; j < 4 ; j++ )
+        g[i][j] = blk[(i & 2) + (j >> 1)]->node.n.sub[2 * (i & 1) + (j & 1)];
+
+    const int gi = !(y & h), gj = !(x & h);
+
+    for ( i = 0 ; i < 4 ; i++ )
+    {
+      Quad *sub[4];
+      int k;
+
+      for ( k = 0 ; k < 4 ; k++ )
+        sub[k] = g[gi + (i >> 1) + (k >> 1)][gj + (i & 1) + (k & 1)];
+
+      quad[i] = pull_(htbl, sub, x & (h - 1), y & (h - 1), d - 1);
+    }
+
+    r = cons_quad(htbl, quad, d);
+
+    op_add_at(htbl, OP_PULL, b, NULL, x, y, r);
+  }
+
+  return r;
+}
+
+// Tree of depth d with q at (x, y), these being multiples of the width of q.
+// Bits of x and y above the width of the tree are ignored.
+Quad *place(Hashtbl *htbl, Quad *q, const BigInt *x, const BigInt *y, int d)
+{
+  if ( d == q->depth )
+    return q;
+
+  Quad *ds = dead_space(htbl, d - 1);
+  Quad *quad[4] = {ds, ds, ds, ds};
+
+  quad[2 * bi_digit(y, d) + bi_digit(x, d)] = place(htbl, q, x, y, d - 1);
+
+  return cons_quad(htbl, quad, d);
+}
+
+// Address of a leaf, see leaf()
+int leaf_bits(Quad *q)
+{
+  int i, k = 0;
+  for ( i = 0 ; i < 4 ; i++ )
+    k |= q->node.l.map[i] << (3 - i);
+
+  return k;
+}
+
+int leaf_op(int op, int a, int b)
+{
+  switch ( op )
+  {
+    case OP_OR:
+      return a | b;
+    case OP_AND:
+      return a & b;
+    case OP_XOR:
+      return a ^ b;
+    case OP_ANDNOT:
+      return a & ~b;
+    default:
+      fprintf(stderr, "leaf_op(): Unknown operation %d\n", op);
+      exit(2);
+  }
+}
+
+// src[j]: quadrant (or cell) of a 2x2 square sent to j by the symmetry s
+void sym_src(int s, int src[4])
+{
+  int i;
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    int r = i >> 1, c = i & 1;
+
+    if ( s & 4 )
+    {
+      const int tmp = r;
+      r = c;
+      c = tmp;
+    }
+
+    r ^= s >> 1 & 1;
+    c ^= s & 1;
+
+    src[2 * r + c] = i;
+  }
+}
+
+// Images are memoized, and so are the failed lookups
+Quad *quad_sym_(Hashtbl *htbl, Quad *q, int s, int create)
+{
+  int src[4], i;
+
+  if ( s == 0 || q->flags & QUAD_EMPTY )
+    return q;
+
+  sym_src(s, src);
+
+  if ( q->depth == 0 )
+  {
+    int k = 0;
+    for ( i = 0 ; i < 4 ; i++ )
+      k |= q->node.l.map[src[i]] << (3 - i);
+
+    return leaf(k);
+  }
+
+  Quad *r = op_find_at(htbl, OP_SYM, q, NULL, s, 0);
+
+  if ( r && (r != &no_sym || !create) )
+    return r == &no_sym ? NULL : r;
+
+  Quad *quad[4];
+
+  for ( i = 0 ; i < 4 ; i++ )
+    if ( !(quad[i] = quad_sym_(htbl, q->node.n.sub[src[i]], s, create)) )
+      break;
+
+  if ( i < 4 )
+    r = NULL;
+  else if ( create )
+    r = cons_quad(htbl, quad, q->depth);
+  else
+    r = cons_find(htbl, quad);
+
+  op_add_at(htbl, OP_SYM, q, NULL, s, 0, r ? r : &no_sym);
+
+  return r;
+}
@@ -0,0 +1,51 @@
+#ifndef QUADOPS_H
+#define QUADOPS_H
+
+#include "bigint.h"
+#include "hashtbl.h"
+
+/* Operations on whole quad trees, without rasterizing them.
+ * Results are memoized in the hashtable (see op_find()). */
+
+// Same pattern, top-left corner kept at the origin, in a tree of depth d
+Quad *quad_pad(Hashtbl *htbl, Quad *q, int d);
+
+// Cell by cell boolean operation, op is one of
+// OP_OR, OP_AND, OP_XOR, OP_ANDNOT (a and not b).
+// Both trees have their top-left corner at the origin,
+// the shallower one is padded.
+Quad *quad_op(Hashtbl *htbl, int op, Quad *a, Quad *b);
+
+int   quad_is_dead(Hashtbl *htbl, Quad *q);
+
+// x increasing towards the right, y towards the bottom
+
+// Tree of depth d containing q with its top-left corner at (x, y),
+// cells outside of the tree are dropped
+Quad *quad_translate(
+  Hashtbl *htbl,
+  Quad *q,
+  const BigInt *x,
+  const BigInt *y,
+  int d);
+
+// Union of dst and of src with its top-left corner at (x, y),
+// dst is padded as needed
+Quad *quad_paste(
+  Hashtbl *htbl,
+  Quad *dst,
+  Quad *src,
+  const BigInt *x,
+  const BigInt *y);
+
+// The 8 symmetries of the square: s & 4 transposes, then s & 2 flips
+// the rows and s & 1 the columns
+#define QUAD_SYMS 8
+
+// Image of q by the symmetry s, in place
+Quad *quad_sym(Hashtbl *htbl, Quad *q, int s);
+
+// Same, but NULL if the image is not in the table: nothing is created
+Quad *quad_sym_find(Hashtbl *htbl, Quad *q, int s);
+
+#endif
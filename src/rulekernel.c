@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "definitions.h"
+#include "rulekernel.h"
+
+// Sub-networks already emitted, by truth table over the 16 counts
+typedef struct Kernel_memo
+{
+  int len;
+  uint16_t tt[KERNEL_MAX_OPS], care[KERNEL_MAX_OPS];
+  int reg[KERNEL_MAX_OPS];
+} Kernel_memo;
+
+int compile_count(Rule_kernel *k, Kernel_memo *m, int tt, int care, int var);
+int compile_mux(Rule_kernel *k, int x, int f1, int f0);
+int restrict_tt(int tt, int var, int v);
+
+/**************************************************/
+
+// rule : B/S, bit n for a birth with n neighbours, bit 9 + n for a survival
+void rule_kernel_compile(Rule_kernel *k, rule r)
+{
+  Kernel_memo m;
+
+  k->r = r;
+  k->len = 0;
+  m.len = 0;
+
+  const int birth = compile_count(k, &m, r & 0x1FF, 0x1FF, 3);
+  const int survival = compile_count(k, &m, r >> 9 & 0x1FF, 0x1FF, 3);
+
+  k->out = compile_mux(k, KREG_ALIVE, survival, birth);
+}
+
+void rule_kernel_apply(
+  const Rule_kernel *k,
+  int n,
+  const uint64_t *alive,
+  uint64_t s[][KERNEL_BATCH],
+  uint64_t *res)
+{
+  uint64_t reg[KERNEL_MAX_OPS][KERNEL_BATCH];
+  const uint64_t *in[KREG_FIRST + KERNEL_MAX_OPS];
+  const uint64_t zero[KERNEL_BATCH] = {0};
+  uint64_t ones[KERNEL_BATCH];
+  int i, j;
+
+  for ( j = 0 ; j < n ; j++ )
+    ones[j] = ~(uint64_t) 0;
+
+  for ( i = 0 ; i < 4 ; i++ )
+    in[i] = s[i];
+
+  in[KREG_ALIVE] = alive;
+  in[KREG_ZERO] = zero;
+  in[KREG_ONES] = ones;
+
+  // Every operation is a multiplexer, some inputs being constants.
+  // The words of the batch are the inner loop, so that the dispatch
+  // is paid once per operation.
+  for ( i = 0 ; i < k->len ; i++ )
+  {
+    const uint64_t *x = in[k->ops[i].x],
+                   *f1 = in[k->ops[i].f1],
+                   *f0 = in[k->ops[i].f0];
+
+    for ( j = 0 ; j < n ; j++ )
+      reg[i][j] = f0[j] ^ ((f1[j] ^ f0[j]) & x[j]);
+
+    in[KREG_FIRST + i] = reg[i];
+  }
+
+  for ( j = 0 ; j < n ; j++ )
+    res[j] = in[k->out][j];
+}
+
+void rule_kernel_step8(const Rule_kernel *k, int n, uint64_t *board)
+{
+  const uint64_t not_w = 0xFEFEFEFEFEFEFEFEull, // column 0 cleared
+                 not_e = 0x7F7F7F7F7F7F7F7Full; // column 7 cleared
+
+  uint64_t s[4][KERNEL_BATCH];
+  int j;
+
+  for ( j = 0 ; j < n ; j++ )
+  {
+    const uint64_t b = board[j];
+    const uint64_t w = (b << 1) & not_w, e = (b >> 1) & not_e;
+
+    const uint64_t nb[8] = {
+      b << 8, w << 8, e << 8,
+      w, e,
+      b >> 8, w >> 8, e >> 8 };
+
+    uint64_t c[4];
+
+    rule_kernel_count(nb, c);
+
+    s[0][j] = c[0];
+    s[1][j] = c[1];
+    s[2][j] = c[2];
+    s[3][j] = c[3];
+  }
+
+  rule_kernel_apply(k, n, board, s, board);
+}
+
+void rule_kernel_print(const Rule_kernel *k)
+{
+  int i;
+
+  printf("rule %u: %d ops\n", (unsigned) k->r, k->len);
+
+  for ( i = 0 ; i < k->len ; i++ )
+    printf("  r%d = r%d ? r%d : r%d\n", KREG_FIRST + i,
+      k->ops[i].x, k->ops[i].f1, k->ops[i].f0);
+
+  printf("  out r%d\n", k->out);
+}
+
+/*** Auxiliary functions ***/
+
+// tt and care are truth tables over the counts 0..15 (bit n for count n),
+// the variables above var being already fixed
+int compile_count(Rule_kernel *k, Kernel_memo *m, int tt, int care, int var)
+{
+  int i;
+
+  tt &= care;
+
+  if ( tt == 0 )
+    return KREG_ZERO;
+  else if ( tt == care )
+    return KREG_ONES;
+
+  for ( i = 0 ; i < m->len ; i++ )
+    if ( m->tt[i] == tt && m->care[i] == care )
+      return m->reg[i];
+
+  const int tt0 = restrict_tt(tt, var, 0), care0 = restrict_tt(care, var, 0),
+            tt1 = restrict_tt(tt, var, 1), care1 = restrict_tt(care, var, 1);
+
+  int reg;
+
+  // Both halves agree where they are defined: var is not needed
+  if ( ((tt0 ^ tt1) & care0 & care1) == 0 )
+    reg = compile_count(k, m,
+      tt0 | (tt1 & ~care0), care0 | care1, var - 1);
+  else
+    reg = compile_mux(k, var,
+      compile_count(k, m, tt1, care1, var - 1),
+      compile_count(k, m, tt0, care0, var - 1));
+
+  if ( m->len < KERNEL_MAX_OPS )
+  {
+    m->tt[m->len] = tt;
+    m->care[m->len] = care;
+    m->reg[m->len++] = reg;
+  }
+
+  return reg;
+}
+
+// x ? f1 : f0, no operation when it is x or a constant
+int compile_mux(Rule_kernel *k, int x, int f1, int f0)
+{
+  if ( f1 == f0 )
+    return f0;
+  else if ( f1 == KREG_ONES && f0 == KREG_ZERO )
+    return x;
+
+  if ( k->len == KERNEL_MAX_OPS )
+  {
+    fprintf(stderr, "rule_kernel_compile(): program too long\n");
+    exit(1);
+  }
+
+  Kernel_op *o = &k->ops[k->len];
+
+  o->x = x;
+  o->f1 = f1;
+  o->f0 = f0;
+
+  return KREG_FIRST + k->len++;
+}
+
+// Cofactor: the table with the bit var of the count set to v
+int restrict_tt(int tt, int var, int v)
+{
+  int n, res = 0;
+
+  for ( n = 0 ; n < 16 ; n++ )
+    if ( tt >> ((n & ~(1 << var)) | (v << var)) & 1 )
+      res |= 1 << n;
+
+  return res;
+}
@@ -0,0 +1,82 @@
+#ifndef RULEKERNEL_H
+#define RULEKERNEL_H
+
+#include <stdint.h>
+#include "definitions.h"
+
+/* Rule compiler: a B/S rule becomes a branch free boolean network
+ * evaluated on 64 cells at once (one per bit).
+ *
+ * The neighbours are counted by a fixed adder tree into 4 bit planes
+ * (s0 the units ... s3 the eights), the rule by a straight line program
+ * on those planes and on the cells themselves. The program is built by
+ * Shannon expansion of the birth and survival sets, shared sub-networks
+ * being emitted once and counts above 8 taken as don't cares:
+ * B3/S23 compiles to 4 operations. */
+
+#define KERNEL_MAX_OPS 64
+
+// Registers 0..3 hold s0..s3, then come the cells and the two constants,
+// op i writes register KREG_FIRST + i
+enum { KREG_ALIVE = 4, KREG_ZERO, KREG_ONES, KREG_FIRST };
+
+// x ? f1 : f0, bitwise. With constant inputs it is also an and, an or...
+typedef struct Kernel_op
+{
+  unsigned char x, f1, f0;
+} Kernel_op;
+
+typedef struct Rule_kernel
+{
+  rule      r;
+  int       len;
+  int       out; // register of the result
+  Kernel_op ops[KERNEL_MAX_OPS];
+} Rule_kernel;
+
+void rule_kernel_compile(Rule_kernel *k, rule r);
+
+// Largest number of words handled by one call
+#define KERNEL_BATCH 16
+
+// Next state of n <= KERNEL_BATCH words of 64 cells, from the bit planes
+// of their neighbour counts. res may be alive.
+void rule_kernel_apply(
+  const Rule_kernel *k,
+  int n,
+  const uint64_t *alive,
+  uint64_t s[][KERNEL_BATCH],
+  uint64_t *res);
+
+// Neighbour counts of 64 cells, from their 8 neighbour planes.
+// Adder tree: three full adders and a half adder on the units,
+// then the carries of weight 2 and 4
+static inline void rule_kernel_count(const uint64_t n[8], uint64_t s[4])
+{
+  const uint64_t x0 = n[0] ^ n[1] ^ n[2],
+                 c0 = (n[0] & n[1]) | (n[2] & (n[0] ^ n[1])),
+                 x1 = n[3] ^ n[4] ^ n[5],
+                 c1 = (n[3] & n[4]) | (n[5] & (n[3] ^ n[4])),
+                 x2 = n[6] ^ n[7],
+                 c2 = n[6] & n[7];
+
+  const uint64_t c3 = (x0 & x1) | (x2 & (x0 ^ x1)),
+                 t0 = c0 ^ c1 ^ c2,
+                 d0 = (c0 & c1) | (c2 & (c0 ^ c1)),
+                 d1 = t0 & c3;
+
+  s[0] = x0 ^ x1 ^ x2;
+  s[1] = t0 ^ c3;
+  s[2] = d0 ^ d1;
+  s[3] = d0 & d1;
+}
+
+// One step of n <= KERNEL_BATCH 8x8 boards, bit 8 * i + j for the cell
+// (i, j). The cells outside are taken as dead, so only the 6x6 center of
+// each board is exact.
+void rule_kernel_step8(const Rule_kernel *k, int n, uint64_t *board);
+
+// Prints the program (debugging)
+void rule_kernel_print(const Rule_kernel *k);
+
+#endif
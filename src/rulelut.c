@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "definitions.h"
+#include "rulekernel.h"
+#include "rulelut.h"
+
+struct Rule_lut
+{
+  rule           r;
+  Rule_lut      *next;
+  Rule_kernel    kernel;
+  unsigned char  lut[1 << 15]; // two 4 bit results per byte
+};
+
+void rule_lut_fill(Rule_lut *lut);
+
+// Tables computed so far, only ever appended to
+Rule_lut        *luts      = NULL;
+pthread_mutex_t  luts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**************************************************/
+
+const Rule_lut *rule_lut(rule r)
+{
+  pthread_mutex_lock(&luts_lock);
+
+  Rule_lut *lut;
+
+  for ( lut = luts ; lut && lut->r != r ; lut = lut->next )
+    ;
+
+  if ( !lut )
+  {
+    lut = malloc(sizeof(Rule_lut));
+
+    if ( !lut )
+    {
+      perror("rule_lut()");
+      exit(1);
+    }
+
+    lut->r = r;
+    rule_kernel_compile(&lut->kernel, r);
+    rule_lut_fill(lut);
+
+    lut->next = luts;
+    luts = lut;
+  }
+
+  pthread_mutex_unlock(&luts_lock);
+
+  return lut;
+}
+
+int rule_lut_step(const Rule_lut *lut, const int k[4])
+{
+  const int key = k[0] << 12 | k[1] << 8 | k[2] << 4 | k[3];
+
+  return lut->lut[key >> 1] >> (4 * (key & 1)) & 15;
+}
+
+const Rule_kernel *rule_lut_kernel(const Rule_lut *lut)
+{
+  return &lut->kernel;
+}
+
+/*** Auxiliary functions ***/
+
+// The squares are evolved by the compiled kernel, as 8x8 boards
+void rule_lut_fill(Rule_lut *lut)
+{
+  uint64_t board[KERNEL_BATCH];
+  int key, b, c;
+
+  for ( key = 0 ; key < 1 << 16 ; key += KERNEL_BATCH )
+  {
+    // Cell (i, j) of the leaf c goes to the row 2 * (c >> 1) + i,
+    // column 2 * (c & 1) + j
+    for ( b = 0 ; b < KERNEL_BATCH ; b++ )
+    {
+      board[b] = 0;
+
+      for ( c = 0 ; c < 4 ; c++ )
+      {
+        const int l = (key + b) >> (12 - 4 * c) & 15;
+        const int shift = 16 * (c >> 1) + 2 * (c & 1);
+
+        board[b] |= (uint64_t) ((l >> 3 & 1) | (l >> 2 & 1) << 1
+                              | (l >> 1 & 1) << 8 | (l & 1) << 9) << shift;
+      }
+    }
+
+    rule_kernel_step8(&lut->kernel, KERNEL_BATCH, board);
+
+    // Cells (1,1) (1,2) (2,1) (2,2) of the squares, two per byte
+    for ( b = 0 ; b < KERNEL_BATCH ; b += 2 )
+    {
+      const uint64_t b0 = board[b], b1 = board[b + 1];
+
+      lut->lut[(key + b) >> 1] =
+          (b0 >> 9 & 1) << 3 | (b0 >> 10 & 1) << 2
+        | (b0 >> 17 & 1) << 1 | (b0 >> 18 & 1)
+        | (b1 >> 9 & 1) << 7 | (b1 >> 10 & 1) << 6
+        | (b1 >> 17 & 1) << 5 | (b1 >> 18 & 1) << 4;
+    }
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef RULELUT_H
+#define RULELUT_H
+
+#include "definitions.h"
+
+/* Evolution of the 4x4 squares (depth 1 nodes) by one step.
+ *
+ * The 2x2 center after one step is stored for each of the 65536
+ * squares, on 4 bits. A table is computed once per rule and shared,
+ * read only, by all the hashtables using that rule. */
+
+typedef struct Rule_lut Rule_lut;
+
+// Thread safe, the table lives until the end of the process
+const Rule_lut *rule_lut(rule r);
+
+// Leaf addresses (see leaf()) of the four quadrants of the square,
+// returns the address of the leaf of its center after one step
+int rule_lut_step(const Rule_lut *lut, const int k[4]);
+
+// Compiled network of the rule (see rulekernel.h)
+const struct Rule_kernel *rule_lut_kernel(const Rule_lut *lut);
+
+#endif
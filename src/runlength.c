@@ -6,41 +6,34 @@
 #include "darray.h"
 #include "parsers.h"
 
-#define RLE_LINE_LENGTH 100
-
-int rle_token(FILE *new_file, char *tag);
-
-int rle_token(FILE *new_file, char *tag)
+void rle_reader_init(Rle_reader *r, FILE *file)
 {
-  static FILE *file = NULL;
-  static char buff[RLE_LINE_LENGTH];
-  static int i;
+  r->file    = file;
+  r->buff[0] = '\0';
+  r->i       = 0;
+}
 
-  if ( new_file != NULL )
-  {
-    file = new_file;
-    buff[0] = '\0';
-    i = 0;
-  }
-  else if ( file == NULL )
+int rle_token(Rle_reader *r, char *tag)
+{
+  if ( r->file == NULL )
     return -1;
 
-  i += strspn(buff + i, " \n\t\r");
+  r->i += strspn(r->buff + r->i, " \n\t\r");
 
-  if ( buff[i] == '\0' )
+  if ( r->buff[r->i] == '\0' )
   {
-    i = 0;
-    if ( fgets(buff, RLE_LINE_LENGTH, file) == NULL )
+    r->i = 0;
+    if ( fgets(r->buff, RLE_LINE_LENGTH, r->file) == NULL )
       return -1;
   }
-  else if ( buff[i] == '!' )
+  else if ( r->buff[r->i] == '!' )
     return 0;
 
   int len;
 
-  len = atoi(buff + i);
-  i += strspn(buff +i, "0123456789");
-  *tag = buff[i++];
+  len = atoi(r->buff + r->i);
+  r->i += strspn(r->buff + r->i, "0123456789");
+  *tag = r->buff[r->i++];
 
   return len ? len : 1;
 }
@@ -116,9 +109,10 @@ int read_rle_(FILE *file, Rle *rle)
   int run_len;
   char tag;
 
-  // Initializes rle_token
-  // Subsequent calls pass NULL
-  run_len = rle_token(file, &tag);
+  Rle_reader reader;
+
+  rle_reader_init(&reader, file);
+  run_len = rle_token(&reader, &tag);
 
   while ( run_len )
   {
@@ -158,7 +152,7 @@ int read_rle_(FILE *file, Rle *rle)
         return 0;
     }
     
-    run_len = rle_token(NULL, &tag);
+    run_len = rle_token(&reader, &tag);
   }
 
   rle_push_line_(lines, cur_line, cur_run,
@@ -198,7 +192,15 @@ void rle_abort_(Darray *lines, Darray *cur_line)
 
 /**/
 
-void bounded_lines(int run_count, char tag, FILE *new_file);
+// Writes runs, breaking the lines after 70 characters
+struct Rle_writer
+{
+  FILE *file;
+  char  a[20];
+  int   line;
+};
+
+void bounded_lines(struct Rle_writer *w, int run_count, char tag);
 
 #define MIN(a,b) (((a) < (b)) ? a : b)
 
@@ -207,57 +209,45 @@ void write_rle(FILE *file, Rle *rle)
   int l, c;
   int prev_line_num = 0;
 
-  bounded_lines(0, '\0', file);
+  struct Rle_writer w = { .file = file, .line = 0 };
 
   for ( l = 0 ; l < MIN(40, rle->rle_lines_c) ; l++ )
   {
-    bounded_lines(rle->rle_lines[l].line_num - prev_line_num,
-                  NEWLINE_RLE_TOKEN, NULL);
+    bounded_lines(&w, rle->rle_lines[l].line_num - prev_line_num,
+                  NEWLINE_RLE_TOKEN);
 
     for ( c = 0 ; c < rle->rle_lines[l].line_length ; c++ )
-      bounded_lines(rle->rle_lines[l].line[c],
-                    c % 2 ? ALIVE_RLE_TOKEN : DEAD_RLE_TOKEN, NULL);
+      bounded_lines(&w, rle->rle_lines[l].line[c],
+                    c % 2 ? ALIVE_RLE_TOKEN : DEAD_RLE_TOKEN);
 
     prev_line_num = rle->rle_lines[l].line_num;
   }
-  printf("\n!\n");
+  fprintf(file, "\n!\n");
   fflush(file);
 }
 
-void bounded_lines(int run_count, char tag, FILE *new_file)
+void bounded_lines(struct Rle_writer *w, int run_count, char tag)
 {
-  static FILE *file = NULL;
-  static char a[20];
-  static int line;
-
-  if ( new_file != NULL )
-  {
-    file = new_file;
-    line = 0;
-  }
-  else if ( file == NULL ) // no file to print to
-    return;
-
-  int written = itoa(a, run_count);
+  int written = itoa(w->a, run_count);
 
   if ( run_count == 1 )
-    a[0] = tag;
+    w->a[0] = tag;
   else if ( run_count > 1 )
   {
-    a[written] = tag;
-    a[written+1] = '\0';
+    w->a[written] = tag;
+    w->a[written+1] = '\0';
     written++;
   }
   else
     return;
 
-  if ( (line += written) > 70 )
+  if ( (w->line += written) > 70 )
   {
-    printf("\n");
-    line = 0;
+    fprintf(w->file, "\n");
+    w->line = 0;
   }
   
-  printf("%s", a);
+  fprintf(w->file, "%s", w->a);
 }
 
 /**/
@@ -3,6 +3,7 @@
 
 /* Run length encoding */
 
+#include <stdio.h>
 #include "darray.h"
 #include "definitions.h"
 #include "parsers.h"
@@ -28,6 +29,21 @@ typedef struct Rle
   } rle_meta;
 } Rle;
 
+#define RLE_LINE_LENGTH 100
+
+// Tokens of the body of a file, all the state of the parser is here
+typedef struct Rle_reader
+{
+  FILE *file;
+  char  buff[RLE_LINE_LENGTH];
+  int   i;
+} Rle_reader;
+
+void rle_reader_init(Rle_reader *r, FILE *file);
+// Returns the length of the next run and its tag,
+// 0 at the end ('!'), -1 on error
+int  rle_token(Rle_reader *r, char *tag);
+
 Rle  * read_rle(FILE *file);
 void  write_rle(FILE *file, Rle *rle);
 void   free_rle(Rle *rle);
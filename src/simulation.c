@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "bigint.h"
+#include "hashtbl.h"
+#include "hashlife.h"
+#include "simulation.h"
+#include "history.h"
+#include "quadops.h"
+#include "escape.h"
+
+struct Sim
+{
+  Hashtbl   *htbl;
+  Sim_state  origin; // generation 0 checkpoint
+  Sim_state  cur;
+  History   *hist;   // checkpoints reached by sim_advance()
+  Escape    *esc;    // removed ships, if pruning
+};
+
+void sim_state_set(Sim_state *dst, const Sim_state *src);
+void sim_state_free(Sim_state *s);
+
+int  sim_centered(Hashtbl *htbl, Quad *q);
+void sim_room(Sim *sim, int t);
+void sim_step(Sim *sim, int t);
+void sim_trim(Sim *sim, int t);
+
+/**************************************************/
+
+Sim *sim_new(Hashtbl *htbl, Quad *q)
+{
+  return sim_new_at(htbl, q, bi_zero_const);
+}
+
+Sim *sim_new_at(Hashtbl *htbl, Quad *q, const BigInt *offset)
+{
+  Sim *sim = malloc(sizeof(Sim));
+
+  if ( !sim )
+  {
+    perror("sim_new()");
+    exit(1);
+  }
+
+  // expand() needs the four subtrees
+  if ( q->depth == 0 )
+  {
+    Quad *ds = dead_space(htbl, 0);
+    Quad *quad[4] = {q, ds, ds, ds};
+
+    q = cons_quad(htbl, quad, 1);
+  }
+
+  sim->htbl = htbl;
+
+  sim->origin.gen    = bi_zero();
+  sim->origin.root   = q;
+  sim->origin.offset = bi_copy(offset);
+
+  sim->cur.gen    = bi_zero();
+  sim->cur.root   = q;
+  sim->cur.offset = bi_copy(offset);
+
+  sim->hist = history_new(SIM_HISTORY_LEN);
+  sim->esc  = NULL;
+
+  return sim;
+}
+
+void sim_free(Sim *sim)
+{
+  sim_state_free(&sim->origin);
+  sim_state_free(&sim->cur);
+  history_free(sim->hist);
+
+  if ( sim->esc )
+    escape_free(sim->esc);
+
+  free(sim);
+}
+
+// Same power-of-two decomposition as destiny(),
+// but the padding is only added when the current root needs it.
+// Only the generation reached is recorded in the history.
+void sim_advance(Sim *sim, const BigInt *bi)
+{
+  int len = bi_log2(bi);
+
+  for ( len-- ; len >= 0 ; len-- )
+  {
+    if ( bi_digit(bi, len) )
+      sim_step(sim, len);
+  }
+
+  history_record(sim->hist, &sim->cur);
+}
+
+// Recorded generations are returned without any evolution
+void sim_goto(Sim *sim, const BigInt *t)
+{
+  // The snapshots do not know which ships were removed
+  const Sim_state *s = sim->esc ? NULL : history_nearest(sim->hist, t);
+
+  if ( sim->esc && bi_cmp(t, sim->cur.gen) < 0 )
+    escape_clear(sim->esc);
+
+  if ( bi_cmp(t, sim->cur.gen) < 0 )
+    sim_state_set(&sim->cur, s ? s : &sim->origin);
+  else if ( s && bi_cmp(sim->cur.gen, s->gen) < 0 )
+    sim_state_set(&sim->cur, s);
+
+  BigInt *delta = bi_sub(t, sim->cur.gen);
+
+  sim_advance(sim, delta);
+
+  bi_free(delta);
+}
+
+const Sim_state *sim_current(Sim *sim)
+{
+  return &sim->cur;
+}
+
+History *sim_history(Sim *sim)
+{
+  return sim->hist;
+}
+
+void sim_set_history(Sim *sim, int capacity)
+{
+  history_free(sim->hist);
+  sim->hist = history_new(capacity);
+}
+
+int sim_set_pruning(Sim *sim, int on)
+{
+  if ( sim->esc )
+    escape_free(sim->esc);
+
+  sim->esc = on ? escape_new(sim->htbl) : NULL;
+
+  return !on || sim->esc;
+}
+
+const Escape *sim_escape(Sim *sim)
+{
+  return sim->esc;
+}
+
+Quad *sim_whole(Sim *sim, int e_min, int *e)
+{
+  if ( sim->esc )
+    return escape_restore(sim->esc, sim->cur.root, sim->cur.offset,
+                          sim->cur.gen, e_min, e);
+
+  Quad *root = sim->cur.root;
+  BigInt *o = sim->cur.offset;
+
+  *e = bi_log2(o) > e_min ? bi_log2(o) : e_min;
+
+  BigInt *p = bi_power_2(*e), *x = bi_sub(p, o);
+
+  Quad *q = quad_translate(sim->htbl, root, x, x,
+    (*e > root->depth ? *e : root->depth) + 1);
+
+  bi_free(p);
+  bi_free(x);
+
+  return q;
+}
+
+void sim_compact(Sim *sim)
+{
+  const int n = history_len(sim->hist);
+  Quad **roots = malloc((n + 2) * sizeof(Quad*));
+  int i;
+
+  if ( !roots )
+  {
+    perror("sim_compact()");
+    exit(1);
+  }
+
+  roots[0] = sim->origin.root;
+  roots[1] = sim->cur.root;
+
+  for ( i = 0 ; i < n ; i++ )
+    roots[i + 2] = history_get(sim->hist, i)->root;
+
+  hashtbl_compact(sim->htbl, roots, n + 2);
+
+  sim->origin.root = roots[0];
+  sim->cur.root    = roots[1];
+
+  for ( i = 0 ; i < n ; i++ )
+    history_set_root(sim->hist, i, roots[i + 2]);
+
+  free(roots);
+}
+
+/*** Auxiliary functions ***/
+
+void sim_state_set(Sim_state *dst, const Sim_state *src)
+{
+  bi_free(dst->gen);
+  bi_free(dst->offset);
+
+  dst->gen    = bi_copy(src->gen);
+  dst->root   = src->root;
+  dst->offset = bi_copy(src->offset);
+}
+
+void sim_state_free(Sim_state *s)
+{
+  bi_free(s->gen);
+  bi_free(s->offset);
+}
+
+// The outer ring of q, of width a quarter of its side, is all dead cells
+int sim_centered(Hashtbl *htbl, Quad *q)
+{
+  if ( q->depth < 2 )
+    return 0;
+
+  Quad *ds = dead_space(htbl, q->depth - 2);
+
+  int i, j;
+  for ( i = 0 ; i < 4 ; i++ )
+    for ( j = 0 ; j < 4 ; j++ )
+      if ( j != 3 - i && q->node.n.sub[i]->node.n.sub[j] != ds )
+        return 0;
+
+  return 1;
+}
+
+// The ships which escape are removed, then one step of 2^t generations
+void sim_step(Sim *sim, int t)
+{
+  if ( sim->esc )
+  {
+    sim->cur.root = escape_prune(sim->esc, sim->cur.root,
+                                 sim->cur.offset, sim->cur.gen, t);
+    sim_trim(sim, t);
+  }
+
+  sim_room(sim, t);
+
+  Quad *q = sim->cur.root;
+
+  sim->cur.root = fate(sim->htbl, expand(sim->htbl, q, q->depth + 1), t);
+
+  BigInt *step = bi_power_2(t),
+         *gen  = bi_add(sim->cur.gen, step);
+
+  bi_free(step);
+  bi_free(sim->cur.gen);
+  sim->cur.gen = gen;
+
+  if ( hashtbl_compaction_due(sim->htbl) )
+    sim_compact(sim);
+}
+
+// Pad the root until no cell can leave it within 2^t steps,
+// then the center of fate(expand(root)) is the whole new generation
+void sim_room(Sim *sim, int t)
+{
+  Quad *q = sim->cur.root;
+
+  while ( q->depth - 1 < t || !sim_centered(sim->htbl, q) )
+  {
+    BigInt *margin = bi_power_2(q->depth),
+           *offset = bi_add(sim->cur.offset, margin);
+
+    bi_free(margin);
+    bi_free(sim->cur.offset);
+    sim->cur.offset = offset;
+
+    q = expand(sim->htbl, q, q->depth + 1);
+  }
+
+  sim->cur.root = q;
+}
+
+// Undoes sim_room() while the root is wider than a step of 2^t needs,
+// and its center is centered too
+void sim_trim(Sim *sim, int t)
+{
+  Quad *q = sim->cur.root;
+
+  while ( q->depth - 2 >= t && sim_centered(sim->htbl, q) )
+  {
+    Quad *quad[4] = {
+      q->node.n.sub[0], q->node.n.sub[1],
+      q->node.n.sub[2], q->node.n.sub[3] };
+    Quad *c = center(sim->htbl, quad, q->depth - 1);
+    BigInt *margin = bi_power_2(q->depth - 1);
+
+    if ( !sim_centered(sim->htbl, c) || bi_cmp(sim->cur.offset, margin) < 0 )
+    {
+      bi_free(margin);
+      break;
+    }
+
+    BigInt *offset = bi_sub(sim->cur.offset, margin);
+
+    bi_free(margin);
+    bi_free(sim->cur.offset);
+    sim->cur.offset = offset;
+
+    q = c;
+  }
+
+  sim->cur.root = q;
+}
@@ -0,0 +1,66 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "bigint.h"
+#include "hashtbl.h"
+
+/* A simulation keeps the current generation of a pattern,
+ * so that successive queries t1 < t2 < ... only cost the differences. */
+
+// A generation of the pattern: the original top-left corner
+// is located at (offset, offset) in root
+typedef struct Sim_state
+{
+  BigInt *gen;
+  Quad   *root;
+  BigInt *offset;
+} Sim_state;
+
+typedef struct Sim Sim;
+
+// Needs Sim_state
+#include "history.h"
+
+Sim  *sim_new(Hashtbl *htbl, Quad *q);
+// The original top-left corner at (offset, offset) in q
+Sim  *sim_new_at(Hashtbl *htbl, Quad *q, const BigInt *offset);
+void  sim_free(Sim *sim);
+
+// Progress by bi steps from the current generation, which is then
+// recorded in the history
+void  sim_advance(Sim *sim, const BigInt *bi);
+
+// Jump to generation t, from the nearest earlier checkpoint
+void  sim_goto(Sim *sim, const BigInt *t);
+
+// The lifetime of the result is that of the current generation
+const Sim_state *sim_current(Sim *sim);
+
+// Generations reached by sim_advance() and sim_goto(), see history.h
+History *sim_history(Sim *sim);
+
+// Replaces the history by an empty one of the given capacity,
+// SIM_HISTORY_LEN by default. 0 records nothing.
+#define SIM_HISTORY_LEN 64
+
+void  sim_set_history(Sim *sim, int capacity);
+
+// Removal of the escaping spaceships before each step (see escape.h),
+// the steps being those of destiny(). The root is trimmed as the ships
+// leave it. Returns 0 if the rule does not allow it.
+// Going back in time then restarts from generation 0.
+int   sim_set_pruning(Sim *sim, int on);
+
+// NULL without pruning
+const struct Escape *sim_escape(Sim *sim);
+
+// Compacts the table (see hashtbl_compact()), keeping the origin, the
+// current generation and the history. The simulation calls it after a
+// step when hashtbl_compaction_due().
+void  sim_compact(Sim *sim);
+
+// The current generation, with the removed ships, in the frame of
+// destiny(): the original top-left corner is at (2^e, 2^e), e >= e_min
+Quad *sim_whole(Sim *sim, int e_min, int *e);
+
+#endif
@@ -1,7 +1,196 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "sparsemap.h"
 #include "slowlife.h"
 
+/* The rows, and in each row the columns of segments, which may hold
+ * live cells at the next generation are enumerated in increasing order:
+ * those at distance at most 1 of a non empty one. */
 
+typedef struct
+{
+    int n;                       // number of words in the batch
+    int i[KERNEL_BATCH], j[KERNEL_BATCH];
+    uint64_t alive[KERNEL_BATCH];
+    uint64_t s[4][KERNEL_BATCH];
+} Batch;
+
+int next_row(const Smap* s, int* a, int last);
+int next_col(Line* rows[3], int pos[3], int last);
+void get_words(Line* l, int* p, int j, uint64_t w[3]);
+int flush_batch(const Rule_kernel* k, Smap* t, Batch* b);
+
+Smap* next_step(const Rule_kernel* k, const Smap* s)
+{
+    Smap *t=emptysmp();
+    int a=0, i=INT_MIN, r, x;
+    Batch b;
+
+    if (t==NULL)
+        return NULL;
+
+    b.n=0;
+
+    while ((i=next_row(s,&a,i))!=INT_MIN)
+    {
+        Line *rows[3]={NULL,NULL,NULL};
+        int pos[3]={0,0,0}, cur[3]={0,0,0};
+        int j=INT_MIN;
+
+        // Lines i-1, i and i+1
+        for (r=a ; r<s->size && s->list[r].i<=i+1 ; r++)
+            rows[s->list[r].i-i+1]=&s->list[r];
+
+        while ((j=next_col(rows,pos,j))!=INT_MIN)
+        {
+            uint64_t w[3][3], we[3][2], n[8], c[4];
+
+            for (r=0 ; r<3 ; r++)
+                get_words(rows[r],&cur[r],j,w[r]);
+
+            // West and east neighbours, across the segments
+            for (r=0 ; r<3 ; r++)
+            {
+                we[r][0]=(w[r][1]<<1)|(w[r][0]>>63);
+                we[r][1]=(w[r][1]>>1)|(w[r][2]<<63);
+            }
+
+            n[0]=we[0][0]; n[1]=w[0][1]; n[2]=we[0][1];
+            n[3]=we[1][0];               n[4]=we[1][1];
+            n[5]=we[2][0]; n[6]=w[2][1]; n[7]=we[2][1];
+
+            rule_kernel_count(n,c);
+
+            b.i[b.n]=i;
+            b.j[b.n]=j;
+            b.alive[b.n]=w[1][1];
+            for (x=0 ; x<4 ; x++)
+                b.s[x][b.n]=c[x];
+
+            if (++b.n==KERNEL_BATCH && !flush_batch(k,t,&b))
+            {
+                freesmp(t);
+                return NULL;
+            }
+        }
+    }
+
+    if (b.n && !flush_batch(k,t,&b))
+    {
+        freesmp(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+Smap* slowlife(const Rule_kernel* k, Smap* s, long t)
+{
+    for ( ; t>0 && s->size ; t--)
+    {
+        Smap *n=next_step(k,s);
+
+        freesmp(s);
+
+        if (n==NULL)
+            return NULL;
+
+        s=n;
+    }
+
+    return s;
+}
+
+/************************************************/
+/************ Auxiliary functions ***************/
+/************************************************/
+
+// Smallest row after last next to a line, INT_MIN if none.
+// a: first line which may be next to a row after last
+int next_row(const Smap* s, int* a, int last)
+{
+    while (*a<s->size && s->list[*a].i<last)
+        (*a)++;
+
+    if (*a==s->size)
+        return INT_MIN;
+
+    if (last==INT_MIN || s->list[*a].i-1>last)
+        return s->list[*a].i-1;
+    else
+        return last+1;
+}
+
+// Same for the columns of segments, in the three rows
+int next_col(Line* rows[3], int pos[3], int last)
+{
+    int r, j=INT_MIN;
+
+    for (r=0 ; r<3 ; r++)
+    {
+        Line *l=rows[r];
+
+        if (l==NULL)
+            continue;
+
+        while (pos[r]<l->size && l->seg[pos[r]].j<last)
+            pos[r]++;
+
+        if (pos[r]<l->size)
+        {
+            int c=l->seg[pos[r]].j-1;
+
+            if (last!=INT_MIN && c<=last)
+                c=last+1;
+
+            if (j==INT_MIN || c<j)
+                j=c;
+        }
+    }
+
+    return j;
+}
+
+// Segments j-1, j and j+1 of the line (0 if absent), p only increases
+void get_words(Line* l, int* p, int j, uint64_t w[3])
+{
+    int x;
+
+    w[0]=w[1]=w[2]=0;
+
+    if (l==NULL)
+        return;
+
+    while (*p<l->size && l->seg[*p].j<j-1)
+        (*p)++;
+
+    for (x=*p ; x<l->size && l->seg[x].j<=j+1 ; x++)
+        w[l->seg[x].j-j+1]=l->seg[x].bits;
+}
+
+// Apply the rule to the batch, append the non empty results to t
+int flush_batch(const Rule_kernel* k, Smap* t, Batch* b)
+{
+    uint64_t res[KERNEL_BATCH];
+    int x;
+
+    rule_kernel_apply(k,b->n,b->alive,b->s,res);
+
+    for (x=0 ; x<b->n ; x++)
+    {
+        if (!res[x])
+            continue;
+
+        if (!t->size || t->list[t->size-1].i!=b->i[x])
+            if (push_line(t,b->i[x])==-1)
+                return 0;
+
+        if (!push_segment(t,t->size-1,b->j[x],res[x]))
+            return 0;
+    }
+
+    b->n=0;
+    return 1;
+}
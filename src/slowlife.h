@@ -2,8 +2,20 @@
 #define SLOWLIFE_H
 
 #include "sparsemap.h"
+#include "rulekernel.h"
 
-Smap* next_step(Smap)
+/* Sparse engine: only the segments holding live cells, and their
+ * neighbours, are visited at each generation. Each segment of 64 cells is
+ * stepped in one go with the bit-sliced kernel of the rule (rulekernel.h).
+ *
+ * Nothing is memoized, so its cost is proportional to the population and
+ * the number of generations. It is cheaper than hashlife on small chaotic
+ * patterns followed over a few generations, and serves as a reference. */
 
-#endif
+// The next generation of s (NULL if out of memory), s is kept
+Smap* next_step(const Rule_kernel* k, const Smap* s);
+
+// Generation t of s, s is freed
+Smap* slowlife(const Rule_kernel* k, Smap* s, long t);
 
+#endif
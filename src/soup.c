@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "definitions.h"
+#include "hashtbl.h"
+#include "conversion.h"
+#include "prgrph.h"
+#include "rulelut.h"
+#include "rulekernel.h"
+#include "soup.h"
+
+#define RING (SOUP_PERIOD_MAX + 1)
+
+// Rows and columns of the live words of a generation, empty if r0 > r1
+typedef struct Box
+{
+  int r0, r1, c0, c1;
+} Box;
+
+struct Soup
+{
+  const Rule_kernel *kernel;
+  int       side;
+  int       margin;
+  int       grid;            // side + 2 * margin
+  int       stride;          // grid + 2, a dead frame around the grid
+  int       gen;
+  uint64_t  lanes;
+  uint64_t  stable;
+  uint64_t  escaped;
+  uint64_t *initial;
+  uint64_t *ring[RING];      // generation g in ring[g % RING]
+  Box       box[RING];
+  int       period[SOUP_LANES];
+  int       settled[SOUP_LANES];
+};
+
+void     soup_step(Soup *s);
+void     soup_check(Soup *s);
+uint64_t soup_diff(const Soup *s, int a, int b);
+Box      box_union(Box a, Box b);
+uint64_t splitmix64(uint64_t *x);
+
+/**************************************************/
+
+Soup *soup_new(rule r, int side, int margin)
+{
+  Soup *s = malloc(sizeof(Soup));
+
+  if ( !s )
+  {
+    perror("soup_new()");
+    exit(1);
+  }
+
+  s->kernel = rule_lut_kernel(rule_lut(r));
+  s->side = side;
+  s->margin = margin;
+  s->grid = side + 2 * margin;
+  s->stride = s->grid + 2;
+
+  const size_t cells = (size_t) s->stride * s->stride;
+  int i;
+
+  s->initial = malloc(cells * sizeof(uint64_t));
+
+  for ( i = 0 ; i < RING ; i++ )
+    s->ring[i] = malloc(cells * sizeof(uint64_t));
+
+  for ( i = 0 ; i < RING ; i++ )
+    if ( !s->initial || !s->ring[i] )
+    {
+      perror("soup_new()");
+      exit(1);
+    }
+
+  soup_clear(s);
+
+  return s;
+}
+
+void soup_free(Soup *s)
+{
+  int i;
+
+  for ( i = 0 ; i < RING ; i++ )
+    free(s->ring[i]);
+
+  free(s->initial);
+  free(s);
+}
+
+void soup_clear(Soup *s)
+{
+  const size_t cells = (size_t) s->stride * s->stride;
+  const Box empty = {s->margin, s->margin - 1, s->margin, s->margin - 1};
+  int i;
+
+  memset(s->initial, 0, cells * sizeof(uint64_t));
+
+  for ( i = 0 ; i < RING ; i++ )
+  {
+    memset(s->ring[i], 0, cells * sizeof(uint64_t));
+    s->box[i] = empty;
+  }
+
+  s->gen = 0;
+  s->lanes = s->stable = s->escaped = 0;
+
+  for ( i = 0 ; i < SOUP_LANES ; i++ )
+    s->period[i] = s->settled[i] = 0;
+}
+
+void soup_seed(Soup *s, int lane, uint64_t seed)
+{
+  uint64_t x = seed, bits = 0;
+  int i, j, n = 0;
+
+  for ( i = 0 ; i < s->side ; i++ )
+    for ( j = 0 ; j < s->side ; j++ )
+    {
+      if ( !n )
+      {
+        bits = splitmix64(&x);
+        n = 64;
+      }
+
+      if ( bits & 1 )
+        soup_set(s, lane, i, j);
+
+      bits >>= 1;
+      n--;
+    }
+
+  s->lanes |= (uint64_t) 1 << lane;
+}
+
+void soup_set(Soup *s, int lane, int i, int j)
+{
+  const int r = s->margin + i, c = s->margin + j;
+  const size_t at = (size_t) (r + 1) * s->stride + c + 1;
+
+  s->initial[at] |= (uint64_t) 1 << lane;
+  s->ring[0][at] |= (uint64_t) 1 << lane;
+  s->lanes |= (uint64_t) 1 << lane;
+
+  // The patterns only start in the side x side square
+  s->box[0].r0 = s->margin;
+  s->box[0].c0 = s->margin;
+  s->box[0].r1 = s->margin + s->side - 1;
+  s->box[0].c1 = s->margin + s->side - 1;
+}
+
+int soup_run(Soup *s, int max_gen)
+{
+  while ( s->gen < max_gen && (s->lanes & ~(s->stable | s->escaped)) )
+  {
+    soup_step(s);
+    soup_check(s);
+  }
+
+  return s->gen;
+}
+
+int soup_generation(const Soup *s)
+{
+  return s->gen;
+}
+
+uint64_t soup_lanes(const Soup *s)
+{
+  return s->lanes;
+}
+
+uint64_t soup_stable(const Soup *s)
+{
+  return s->stable;
+}
+
+uint64_t soup_escaped(const Soup *s)
+{
+  return s->escaped;
+}
+
+int soup_period(const Soup *s, int lane)
+{
+  return s->period[lane];
+}
+
+int soup_settled(const Soup *s, int lane)
+{
+  return s->settled[lane];
+}
+
+int soup_population(const Soup *s, int lane)
+{
+  const uint64_t *cur = s->ring[s->gen % RING];
+  const Box b = s->box[s->gen % RING];
+  int i, j, pop = 0;
+
+  for ( i = b.r0 ; i <= b.r1 ; i++ )
+    for ( j = b.c0 ; j <= b.c1 ; j++ )
+      pop += cur[(size_t) (i + 1) * s->stride + j + 1] >> lane & 1;
+
+  return pop;
+}
+
+int soup_grid(const Soup *s)
+{
+  return s->grid;
+}
+
+int soup_cell(const Soup *s, int lane, int i, int j)
+{
+  return s->ring[s->gen % RING][(size_t) (i + 1) * s->stride + j + 1]
+    >> lane & 1;
+}
+
+Quad *soup_quad(const Soup *s, Hashtbl *htbl, int lane, int initial)
+{
+  const uint64_t *cur = initial ? s->initial : s->ring[s->gen % RING];
+  Prgrph p;
+
+  p.prgrph = alloc_prgrph(s->grid, s->grid, sizeof(char));
+  p.m = s->grid;
+
+  if ( !p.prgrph )
+  {
+    perror("soup_quad()");
+    exit(1);
+  }
+
+  int i, j;
+  for ( i = 0 ; i < s->grid ; i++ )
+    for ( j = 0 ; j < s->grid ; j++ )
+      p.prgrph[i][j] =
+        cur[(size_t) (i + 1) * s->stride + j + 1] >> lane & 1 ? ALIVE : DEAD;
+
+  Quad *q = prgrph_to_quad(htbl, p);
+  free_prgrph(p);
+
+  return q;
+}
+
+/*** Auxiliary functions ***/
+
+// One generation of all the lanes, by batches of words of a row
+void soup_step(Soup *s)
+{
+  const int src = s->gen % RING, dst = (s->gen + 1) % RING;
+  const uint64_t *cur = s->ring[src];
+  uint64_t *nxt = s->ring[dst];
+  const int w = s->stride;
+
+  // The live cells spread by one, and the cells left from the older
+  // generation in nxt must be overwritten
+  Box in = s->box[src], out = {s->grid, -1, s->grid, -1};
+
+  if ( in.r0 <= in.r1 )
+  {
+    in.r0 = in.r0 > 0 ? in.r0 - 1 : 0;
+    in.c0 = in.c0 > 0 ? in.c0 - 1 : 0;
+    in.r1 = in.r1 < s->grid - 1 ? in.r1 + 1 : s->grid - 1;
+    in.c1 = in.c1 < s->grid - 1 ? in.c1 + 1 : s->grid - 1;
+  }
+
+  in = box_union(in, s->box[dst]);
+
+  int i, j, b;
+  for ( i = in.r0 ; i <= in.r1 ; i++ )
+    for ( j = in.c0 ; j <= in.c1 ; j += KERNEL_BATCH )
+    {
+      const int n = in.c1 - j + 1 < KERNEL_BATCH ? in.c1 - j + 1 : KERNEL_BATCH;
+      const uint64_t *c = cur + (size_t) (i + 1) * w + j + 1;
+      uint64_t cnt[4][KERNEL_BATCH], *res = nxt + (size_t) (i + 1) * w + j + 1;
+
+      for ( b = 0 ; b < n ; b++ )
+      {
+        const uint64_t nb[8] = {
+          c[b - w - 1], c[b - w], c[b - w + 1],
+          c[b - 1], c[b + 1],
+          c[b + w - 1], c[b + w], c[b + w + 1] };
+        uint64_t sum[4];
+
+        rule_kernel_count(nb, sum);
+
+        cnt[0][b] = sum[0];
+        cnt[1][b] = sum[1];
+        cnt[2][b] = sum[2];
+        cnt[3][b] = sum[3];
+      }
+
+      rule_kernel_apply(s->kernel, n, c, cnt, res);
+
+      for ( b = 0 ; b < n ; b++ )
+        if ( res[b] )
+        {
+          if ( i < out.r0 ) out.r0 = i;
+          if ( i > out.r1 ) out.r1 = i;
+          if ( j + b < out.c0 ) out.c0 = j + b;
+          if ( j + b > out.c1 ) out.c1 = j + b;
+
+          // The cells beyond the border are lost
+          if ( i == 0 || i == s->grid - 1 || j + b == 0 || j + b == s->grid - 1 )
+            s->escaped |= res[b] & ~s->stable;
+        }
+    }
+
+  s->box[dst] = out;
+  s->gen++;
+}
+
+// Lanes equal to one of their previous generations
+void soup_check(Soup *s)
+{
+  int p, l;
+
+  for ( p = 1 ; p <= SOUP_PERIOD_MAX && p <= s->gen ; p++ )
+  {
+    const uint64_t found = s->lanes & ~(s->stable | s->escaped)
+                         & ~soup_diff(s, s->gen, s->gen - p);
+
+    for ( l = 0 ; l < SOUP_LANES ; l++ )
+      if ( found >> l & 1 )
+      {
+        s->period[l] = p;
+        s->settled[l] = s->gen;
+      }
+
+    s->stable |= found;
+  }
+}
+
+// Lanes differing between the generations a and b of the ring
+uint64_t soup_diff(const Soup *s, int a, int b)
+{
+  const uint64_t *x = s->ring[a % RING], *y = s->ring[b % RING];
+  const Box box = box_union(s->box[a % RING], s->box[b % RING]);
+  uint64_t diff = 0;
+  int i, j;
+
+  for ( i = box.r0 ; i <= box.r1 ; i++ )
+  {
+    const size_t row = (size_t) (i + 1) * s->stride + 1;
+
+    for ( j = box.c0 ; j <= box.c1 ; j++ )
+      diff |= x[row + j] ^ y[row + j];
+  }
+
+  return diff;
+}
+
+Box box_union(Box a, Box b)
+{
+  if ( a.r0 > a.r1 )
+    return b;
+  else if ( b.r0 > b.r1 )
+    return a;
+
+  Box u = {
+    a.r0 < b.r0 ? a.r0 : b.r0, a.r1 > b.r1 ? a.r1 : b.r1,
+    a.c0 < b.c0 ? a.c0 : b.c0, a.c1 > b.c1 ? a.c1 : b.c1 };
+
+  return u;
+}
+
+uint64_t splitmix64(uint64_t *x)
+{
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+  return z ^ (z >> 31);
+}
@@ -0,0 +1,64 @@
+#ifndef SOUP_H
+#define SOUP_H
+
+#include <stdint.h>
+#include "definitions.h"
+#include "hashtbl.h"
+
+/* 64 small patterns evolved at once, one per bit of the words.
+ *
+ * Each cell of a square grid is a word, whose bit l is the cell of the
+ * lane l, and a step of all the lanes is one pass of the compiled rule
+ * (see rulekernel.h) over the grid: no hashing, for the short evolutions
+ * of random soups. The grid is bounded, a lane reaching its border is
+ * flagged as escaped and is no longer exact.
+ *
+ * A lane is stable when it is equal to one of its SOUP_PERIOD_MAX
+ * previous generations. The lanes which do not settle can be handed to
+ * hashlife with soup_quad(). */
+
+#define SOUP_LANES 64
+#define SOUP_PERIOD_MAX 6
+
+typedef struct Soup Soup;
+
+// Patterns of side x side cells, in the center of a grid with margin
+// cells on each side
+Soup *soup_new(rule r, int side, int margin);
+void  soup_free(Soup *s);
+
+// All lanes dead, back to the generation 0
+void  soup_clear(Soup *s);
+
+// Random side x side pattern of density 1/2 in the lane, at generation 0,
+// drawn from the seed only
+void  soup_seed(Soup *s, int lane, uint64_t seed);
+
+// Cell (i, j) of the side x side square of the lane alive at generation 0
+void  soup_set(Soup *s, int lane, int i, int j);
+
+// Steps until every lane seeded is stable or escaped, at most up to the
+// generation max_gen, returns the generation reached
+int   soup_run(Soup *s, int max_gen);
+
+int      soup_generation(const Soup *s);
+uint64_t soup_lanes(const Soup *s); // lanes seeded or set
+uint64_t soup_stable(const Soup *s);
+uint64_t soup_escaped(const Soup *s);
+
+// Period of a stable lane (0 otherwise), and the generation at which
+// it was found periodic
+int   soup_period(const Soup *s, int lane);
+int   soup_settled(const Soup *s, int lane);
+
+int   soup_population(const Soup *s, int lane);
+
+// Side of the grid, and its cell (i, j) in the lane
+int   soup_grid(const Soup *s);
+int   soup_cell(const Soup *s, int lane, int i, int j);
+
+// The lane at the current generation (or at the generation 0) as a
+// quad tree of htbl, the top-left corner of the grid at (0, 0)
+Quad *soup_quad(const Soup *s, Hashtbl *htbl, int lane, int initial);
+
+#endif
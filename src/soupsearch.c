@@ -0,0 +1,79 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "definitions.h"
+#include "parsers.h"
+#include "census.h"
+#include "stats.h"
+
+/* Soup search driver: runs a number of seeded 16x16 soups on all the
+ * cores and prints the census of their ash, with the soups per second. */
+
+int main(int argc, char *argv[])
+{
+  const char *seed = "hashislife", *out_file = NULL;
+  char rule_buff[32] = "b3/s23";
+  long soups = 10000, first = 0;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN), opt;
+
+  while ( (opt = getopt(argc, argv, "n:f:j:s:R:o:")) != -1 )
+  {
+    switch ( opt )
+    {
+      case 'n': soups = atol(optarg); break;
+      case 'f': first = atol(optarg); break;
+      case 'j': threads = atoi(optarg); break;
+      case 's': seed = optarg; break;
+      case 'R':
+        strncpy(rule_buff, optarg, sizeof(rule_buff) - 1);
+        break;
+      case 'o': out_file = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-n soups] [-f first] [-j threads] "
+                        "[-s seed] [-R rule] [-o census.txt]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  const rule r = parse_rule(rule_buff);
+
+  if ( r == (rule) -1 || (r & 1) )
+  {
+    fprintf(stderr, "unsupported rule %s\n", rule_buff);
+    return 1;
+  }
+
+  if ( threads < 1 )
+    threads = 1;
+
+  Census *c = census_new();
+
+  const double t0 = stats_now();
+  census_search(c, r, seed, first, soups, threads);
+  const double t1 = stats_now();
+
+  fprintf(stderr, "%ld soups in %.3f s on %d threads: %.1f soups/s\n",
+    census_soups(c), t1 - t0, threads, census_soups(c) / (t1 - t0));
+
+  FILE *out = out_file ? fopen(out_file, "w") : stdout;
+
+  if ( !out )
+  {
+    perror(out_file);
+    return 1;
+  }
+
+  fprintf(out, "rule %s, seed %s, soups %ld to %ld\n",
+    rule_buff, seed, first, first + soups - 1);
+  census_print(out, c);
+
+  if ( out_file )
+    fclose(out);
+
+  census_free(c);
+
+  return 0;
+}
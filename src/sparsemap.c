@@ -3,16 +3,26 @@
 
 #include "sparsemap.h"
 
+int new_line(Line* l, int i, int len);
+int extend_line(Line* l);
+
 Smap* emptysmp()
 {
     Smap *s=malloc(sizeof(Smap));
 
     if (s==NULL)
-	return NULL;
+        return NULL;
 
     s->len=MIN_LIN;
     s->size=0;
-    s->list=malloc(MIN_LIN*sizeof(int*));
+    s->list=malloc(MIN_LIN*sizeof(Line));
+
+    if (s->list==NULL)
+    {
+        free(s);
+        return NULL;
+    }
+
     return s;
 }
 
@@ -20,7 +30,8 @@ void freesmp(Smap* s)
 {
     int i;
     for (i=0 ; i<s->size ; i++)
-	free(s->list[i]);
+        free(s->list[i].seg);
+    free(s->list);
     free(s);
 }
 
@@ -29,16 +40,11 @@ int open_line(Smap* s, int i)
     // Have to extend queue
     if (s->size==s->len)
     {
-        int _i;
-        int **_list=malloc(2*s->len*sizeof(int*));
+        Line *_list=realloc(s->list, 2*s->len*sizeof(Line));
 
         if (_list==NULL)
             return -1;
 
-        for (_i=0 ; _i<s->len ; _i++)
-            _list[_i]=s->list[_i];
-
-        free(s->list);
         s->list=_list;
         s->len<<=1;
     }
@@ -46,50 +52,46 @@ int open_line(Smap* s, int i)
     int i_;
     i_=find_line(s->list,i,0,s->size);
 
-    if (i_==s->size || s->list[i_][0]!=i)
+    if (i_==s->size || s->list[i_].i!=i)
     {
+        Line l;
         int _i;
 
-        for (_i=s->size ; _i>i_ ; i--)
-            s->list[_i]=s->list[_i-1];
-
-        s->list[i_]=new_line(i, MIN_COL);
-
-        if (s->list==NULL)
+        // Before the shift, which cannot be undone
+        if (!new_line(&l, i, MIN_COL))
             return -1;
 
+        for (_i=s->size ; _i>i_ ; _i--)
+            s->list[_i]=s->list[_i-1];
+
+        s->list[i_]=l;
         s->size++;
 #ifdef DEBUG_SMP
         printf("NEW LINE %d at %d\n", i, i_);
 #endif
-        return i_;
     }
-    else
-        return i_;
+
+    return i_;
 }
 
 int push_line(Smap* s, int i)
 {
-    // Have to extend queue
-    if (s->size==s->len)
+    if (!s->size || i>s->list[s->size-1].i) // Lazy evaluation
     {
-        int _i;
-        int **_list=malloc(2*s->len*sizeof(int*));
+        if (s->size==s->len)
+        {
+            Line *_list=realloc(s->list, 2*s->len*sizeof(Line));
 
-	if (_list==NULL)
-	    return -1;
+            if (_list==NULL)
+                return -1;
 
-        for (_i=0 ; _i<s->len ; _i++)
-            _list[_i]=s->list[_i];
+            s->list=_list;
+            s->len<<=1;
+        }
 
-        free(s->list);
-        s->list=_list;
-        s->len<<=1;
-    }
+        if (!new_line(&s->list[s->size], i, MIN_COL))
+            return -1;
 
-    if (!s->size || i>s->list[s->size-1][0]) // Lazy evaluation
-    {
-        s->list[s->size]=new_line(i,MIN_COL);
         return s->size++;
     }
     else
@@ -99,21 +101,80 @@ int push_line(Smap* s, int i)
 
 int add_point(Smap* s, int i_s, int j)
 {
+    Line *l=&s->list[i_s];
+    const int w=j>>6; // floor, also for negative columns
+    int j_=find_seg(l,w,0,l->size);
+
 #ifdef DEBUG_SMP
-    printf("Added %d %d\n", s->list[i_s][0], j);
+    printf("Added %d %d\n", l->i, j);
 #endif
-    return insert_point(&s->list[i_s],j);
+
+    if (j_==l->size || l->seg[j_].j!=w)
+    {
+        int _j;
+
+        if (l->size==l->len && !extend_line(l))
+            return 0;
+
+        for (_j=l->size ; _j>j_ ; _j--)
+            l->seg[_j]=l->seg[_j-1];
+
+        l->seg[j_].j=w;
+        l->seg[j_].bits=0;
+        l->size++;
+    }
+
+    l->seg[j_].bits|=(uint64_t)1<<(j&63);
+    return 1;
+}
+
+// The segments of a line must be pushed in increasing order
+int push_segment(Smap* s, int i_s, int j, uint64_t bits)
+{
+    Line *l=&s->list[i_s];
+
+    if (l->size==l->len && !extend_line(l))
+        return 0;
+
+    l->seg[l->size].j=j;
+    l->seg[l->size].bits=bits;
+    l->size++;
+    return 1;
+}
+
+int qadd_point(Smap* s, int i, int j)
+{
+    int i_s=open_line(s,i);
+
+    return i_s>=0 && add_point(s,i_s,j);
 }
 
-int push_point(Smap* s, int i_s, int j)
+int get_point(const Smap* s, int i, int j)
 {
-    return _push_point(&s->list[i_s],j);
-    
+    int i_=find_line(s->list,i,0,s->size);
+
+    if (i_==s->size || s->list[i_].i!=i)
+        return 0;
+
+    Line *l=&s->list[i_];
+    int j_=find_seg(l,j>>6,0,l->size);
+
+    if (j_==l->size || l->seg[j_].j!=j>>6)
+        return 0;
+
+    return l->seg[j_].bits>>(j&63)&1;
 }
 
-void qadd_point(Smap* s, int i, int j)
+long smp_population(const Smap* s)
 {
-    add_point(s,open_line(s,i),j);
+    long n=0;
+    int i, j;
+
+    for (i=0 ; i<s->size ; i++)
+        for (j=0 ; j<s->list[i].size ; j++)
+            n+=__builtin_popcountll(s->list[i].seg[j].bits);
+
+    return n;
 }
 
 /***********************************************/
@@ -124,6 +185,8 @@ Smap* smp_of_bmp(int** b, int m, int n)
     int i, j, i_;
     Smap *s=emptysmp();
 
+    if (s==NULL)
+        return NULL;
 
     for (i=0 ; i<m ; i++)
     {
@@ -133,15 +196,15 @@ Smap* smp_of_bmp(int** b, int m, int n)
             {
                 if (i_==-1)
                     if ((i_=push_line(s,i))==-1)
-		    {
-			freesmp(s);
-			return NULL;
-		    }
-                if (!push_point(s,i_,j))
-		{
-		    freesmp(s);
-		    return NULL;
-		}
+                    {
+                        freesmp(s);
+                        return NULL;
+                    }
+                if (!add_point(s,i_,j))
+                {
+                    freesmp(s);
+                    return NULL;
+                }
             }
     }
     return s;
@@ -158,6 +221,9 @@ void print_smap(Smap s, int xM, int xm, int yM, int ym)
 
     char *empty_line=malloc((yM-ym+4)*sizeof(char));
 
+    if (empty_line==NULL)
+        return;
+
     empty_line[0]=LIMITER;
     empty_line[yM-ym+1]=LIMITER;
     empty_line[yM-ym+2]='\n';
@@ -171,15 +237,19 @@ void print_smap(Smap s, int xM, int xm, int yM, int ym)
 
     for (i=0 ; i<s.size ; i++)
     {
-        if (s.list[i][0]<xm)
+        if (s.list[i].i<xm)
             continue;
-        else if (s.list[i][0]>=xM)
+        else if (s.list[i].i>=xM)
             break;
         else
         {
-            while (i_++<s.list[i][0])
-              printf("%s",empty_line);
-            print_line(s.list[i],yM,ym);
+            while (i_<s.list[i].i)
+            {
+                printf("%s",empty_line);
+                i_++;
+            }
+            print_line(&s.list[i],yM,ym);
+            i_++;
         }
     }
 
@@ -190,6 +260,7 @@ void print_smap(Smap s, int xM, int xm, int yM, int ym)
         printf("%c",LIMITER);
     printf("\n");
 
+    free(empty_line);
     return;
 }
 
@@ -198,144 +269,76 @@ void print_smap(Smap s, int xM, int xm, int yM, int ym)
 /************ Auxiliary functions ***************/
 /************************************************/
 
-void print_line(int* l, int yM, int ym)
+void print_line(Line* l, int yM, int ym)
 {
-    int j,j_=ym;
+    int j,s=0;
 
     printf("%c",LIMITER);
 
-    for (j=3 ; j<l[2]+3 ; j++)
+    for (j=ym ; j<yM ; j++)
     {
-        if (l[j]<ym)
-            continue;
-        else if (l[j]>=yM)
-            break;
+        while (s<l->size && l->seg[s].j<j>>6)
+            s++;
+
+        if (s<l->size && l->seg[s].j==j>>6 && l->seg[s].bits>>(j&63)&1)
+            printf("%c",LIVCELL);
         else
-        {
-            while (j_++<l[j])
-                printf("%c",DEDCELL);
-            printf("%c",ALIVE);
-        }
+            printf("%c",DEDCELL);
     }
 
-    while (j_++<yM)
-        printf("%c",DEDCELL);
-
     printf("%c\n",LIMITER);
     return;
 }
 
-// find min(i_|s[i_][0]>=i), a<=i<b
-int find_line(int** s, int i, int a, int b)
+// find min(i_|s[i_].i>=i), a<=i_<=b
+int find_line(Line* s, int i, int a, int b)
 {
-    if (a<b)
+    while (a<b)
     {
         int c = (a+b)/2;
-        if (s[c][0]>i)
-            return find_line(s, i, a, c);
-        else if (s[c][0]<i)
-            return find_line(s, i, c+1, b);
+        if (s[c].i<i)
+            a=c+1;
         else
-            return c;
+            b=c;
     }
-    else return a;
-}
-
-int* new_line(int i, int len)
-{
-    int *l=malloc((len+3)*sizeof(int*));
-
-    if (l==NULL)
-	return NULL;
-
-    l[0]=i;
-    l[1]=len;
-    l[2]=0;
-    return l;
+    return a;
 }
 
-int find_col(int* s, int j, int a, int b)
+// find min(j_|l->seg[j_].j>=j), a<=j_<=b
+int find_seg(Line* l, int j, int a, int b)
 {
-    if (a<b)
+    while (a<b)
     {
         int c = (a+b)/2;
-        if (s[c]<j)
-            return find_col(s,j,c+1,b);
-        else if (s[c]>j)
-            return find_col(s,j,a,c-1);
+        if (l->seg[c].j<j)
+            a=c+1;
         else
-            return c;
+            b=c;
     }
-    else
-        return a;
+    return a;
 }
 
-int insert_point(int** list, int j)
+int new_line(Line* l, int i, int len)
 {
-    int *l=*list;
-    // Have to extend
-    if (l[2]==l[1])
-    {
-        int _j;
-        int *l2=new_line(l[0],2*l[1]);
-
-        if (l2==NULL)
-            return 0;
-
-        for (_j=3 ; _j<l[1]+3 ; _j++)
-            l2[_j]=l[_j];
+    l->seg=malloc(len*sizeof(Segment));
 
-        free(l);
-        l=l2;
-    }
-
-    int j_;
-    j_=find_col(l,j,3,l[2]+3);
-
-    if (j_==l[2]+3 || l[j_]!=j)
-    {
-        int _j;
-
-        l[2]++;
-
-        for (_j=l[2]+3 ; _j>j_ ; _j--)
-            l[_j]=l[_j-1];
-
-        l[j_]=j;
+    if (l->seg==NULL)
+        return 0;
 
-#ifdef DEBUG_SMP
-        printf("NEW COL %d\n", j_);
-#endif
-        return j_;
-    }
-    else
-        return j_;
+    l->i=i;
+    l->len=len;
+    l->size=0;
+    return 1;
 }
 
-int _push_point(int** list, int j)
+int extend_line(Line* l)
 {
-    int *l=*list;
-    // Have to extend
-    if (l[2]==l[1])
-    {
-        int _j;
-        int *l2=new_line(l[0],2*l[1]);
-
-        if (l2==NULL)
-            return 0;
-
-        for (_j=3 ; _j<l[1]+3 ; _j++)
-            l2[_j]=l[_j];
+    Segment *seg=realloc(l->seg, 2*l->len*sizeof(Segment));
 
-        free(l);
-        l=l2;
-    }
-
-    if (!l[2] || j>l[3+l[2]-1])
-    {
-        l[3+l[2]]=j;
-        return 3+l[2]++;
-    }
-    else
+    if (seg==NULL)
         return 0;
+
+    l->seg=seg;
+    l->len<<=1;
+    return 1;
 }
@@ -1,39 +1,61 @@
 #ifndef SPARSEMAP_H
 #define SPARSEMAP_H
 
+#include <stdint.h>
+
+/* Sparse map: the rows holding live cells, sorted, each one made of its
+ * non empty segments of 64 cells, sorted.
+ * The bit k of the segment j of a row is the cell of column 64*j+k. */
+
 #define MIN_LIN 8
-#define MIN_COL 8
+#define MIN_COL 4
 #define LIMITER '.'
 #define DEDCELL ' '
-#define ALIVE   '0'
+#define LIVCELL '0'
+
+typedef struct
+{
+    int j;
+    uint64_t bits;
+} Segment;
 
 typedef struct
 {
-    int len, size, **list;
+    int i, len, size; // row, capacity, number of segments
+    Segment *seg;
+} Line;
+
+typedef struct
+{
+    int len, size;
+    Line *list;
 } Smap;
 
 Smap* emptysmp();
 
 void freesmp(Smap* s);
 
+// Index of the line i, inserted if needed (-1 if out of memory)
 int open_line(Smap* t, int i);
+// Same, faster when i is after the last line
 int push_line(Smap* t, int i);
 
 int add_point(Smap* t, int i_s, int j);
-int push_point(Smap* t, int i_s, int j);
+int push_segment(Smap* t, int i_s, int j, uint64_t bits);
+
+// Inserts the line if needed, 0 if out of memory
+int qadd_point(Smap* t, int i, int j);
+int get_point(const Smap* t, int i, int j);
 
-void qadd_point(Smap* t, int i, int j);
+long smp_population(const Smap* t);
 
 Smap* smp_of_bmp(int** b, int m, int n);
 
 void print_smap(Smap s, int xM, int xm, int yM, int ym);
 
 
-void print_line(int* l, int yM, int ym);
-int find_line(int** s, int i, int a, int b);
-int* new_line(int i, int len);
-int find_col(int* s, int j, int a, int b);
+void print_line(Line* l, int yM, int ym);
+int find_line(Line* s, int i, int a, int b);
+int find_seg(Line* l, int j, int a, int b);
 
-int insert_point(int** l, int j);
-int _insert_point(int** l, int j);
 #endif
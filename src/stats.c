@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <time.h>
+#include "stats.h"
+
+void write_depths(FILE *file, const char *name, const long *hits,
+                  const long *misses, int len);
+
+/**************************************************/
+
+void stats_write_json(FILE *file, const Stats *stats)
+{
+  fprintf(file, "  \"cons_hits\": %ld,\n", stats->cons_hits);
+  fprintf(file, "  \"cons_misses\": %ld,\n", stats->cons_misses);
+  fprintf(file, "  \"fate_hits\": %ld,\n", stats->fate_hits);
+  fprintf(file, "  \"fate_misses\": %ld,\n", stats->fate_misses);
+  fprintf(file, "  \"fate_inert\": %ld,\n", stats->fate_inert);
+  fprintf(file, "  \"fate_sym\": %ld,\n", stats->fate_sym);
+  fprintf(file, "  \"dead_hits\": %ld,\n", stats->dead_hits);
+  fprintf(file, "  \"dead_misses\": %ld,\n", stats->dead_misses);
+  fprintf(file, "  \"compactions\": %ld,\n", stats->compactions);
+  fprintf(file, "  \"compact_freed\": %ld,\n", stats->compact_freed);
+
+  write_depths(file, "cons_by_depth", stats->cons_hits_d,
+               stats->cons_misses_d, STATS_DEPTH);
+
+  // Only the (depth, t) pairs which were reached
+  fprintf(file, "  \"fate_by_depth_t\": [");
+
+  int d, t, first = 1;
+  for ( d = 0 ; d < STATS_DEPTH ; d++ )
+    for ( t = 0 ; t < STATS_DEPTH ; t++ )
+    {
+      const long h = stats->fate_hits_dt[d][t],
+                 m = stats->fate_misses_dt[d][t];
+
+      if ( !h && !m )
+        continue;
+
+      fprintf(file, "%s\n    {\"depth\": %d, \"t\": %d, "
+                    "\"hits\": %ld, \"misses\": %ld}",
+              first ? "" : ",", d, t, h, m);
+      first = 0;
+    }
+
+  fprintf(file, "\n  ],\n");
+
+  // probes[i]: lookups which compared i nodes
+  int len = STATS_PROBE;
+  while ( len > 0 && !stats->probes[len-1] )
+    len--;
+
+  fprintf(file, "  \"probes\": [");
+
+  int i;
+  for ( i = 0 ; i < len ; i++ )
+    fprintf(file, "%s%ld", i ? ", " : "", stats->probes[i]);
+
+  fprintf(file, "]\n");
+}
+
+void write_depths(FILE *file, const char *name, const long *hits,
+                  const long *misses, int len)
+{
+  fprintf(file, "  \"%s\": [", name);
+
+  int d, first = 1;
+  for ( d = 0 ; d < len ; d++ )
+  {
+    if ( !hits[d] && !misses[d] )
+      continue;
+
+    fprintf(file, "%s\n    {\"depth\": %d, \"hits\": %ld, \"misses\": %ld}",
+            first ? "" : ",", d, hits[d], misses[d]);
+    first = 0;
+  }
+
+  fprintf(file, "\n  ],\n");
+}
+
+double stats_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
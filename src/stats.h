@@ -0,0 +1,52 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* Counters maintained by a hashtable and by the algorithms using it.
+ * The per depth counters cost an increment in cons_quad() and fate(),
+ * compile with -DNO_DEPTH_STATS to leave them at zero. */
+
+#define STATS_DEPTH 128 // deeper nodes are counted in the last slot
+#define STATS_PROBE 32  // longer probes are counted in the last slot
+
+typedef struct Stats
+{
+  long cons_hits;   // cons_quad() found the node
+  long cons_misses; // cons_quad() created the node
+  long fate_hits;   // fate() found its result memoized
+  long fate_misses;
+  long fate_inert;  // fate() of a stable or period 2 node, not memoized
+  long fate_sym;    // fate() found the result of a rotated or reflected node
+  long dead_hits;   // dead_space() returned a known node
+  long dead_misses;
+  long compactions;   // hashtbl_compact() calls
+  long compact_freed; // nodes released by them
+
+  long cons_hits_d[STATS_DEPTH];
+  long cons_misses_d[STATS_DEPTH];
+  long fate_hits_dt[STATS_DEPTH][STATS_DEPTH];   // by depth and t
+  long fate_misses_dt[STATS_DEPTH][STATS_DEPTH];
+  long probes[STATS_PROBE]; // lookups by number of nodes compared
+} Stats;
+
+#ifdef NO_DEPTH_STATS
+#define STATS_D(a, d)
+#define STATS_DT(a, d, t)
+#else
+#define STATS_D(a, d) ((a)[stats_slot(d)]++)
+#define STATS_DT(a, d, t) ((a)[stats_slot(d)][stats_slot(t)]++)
+#endif
+
+static inline int stats_slot(int d)
+{
+  return d < STATS_DEPTH ? d : STATS_DEPTH - 1;
+}
+
+// Writes the counters as the members of a JSON object
+void stats_write_json(FILE *file, const Stats *stats);
+
+// Seconds on the monotonic clock, for the timers of all the modules
+double stats_now(void);
+
+#endif
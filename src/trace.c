@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "stats.h"
+#include "trace.h"
+
+struct Trace
+{
+  FILE   *out;
+  int     min_depth;
+  int     sample;
+  double  origin;             // microseconds
+  long    events;
+  long    calls[STATS_DEPTH]; // calls seen at each depth
+};
+
+/**************************************************/
+
+Trace *trace_new(FILE *out, int min_depth, int sample)
+{
+  Trace *tr = calloc(1, sizeof(Trace));
+
+  if ( !tr )
+  {
+    perror("trace_new()");
+    exit(1);
+  }
+
+  tr->out       = out;
+  tr->min_depth = min_depth;
+  tr->sample    = sample < 1 ? 1 : sample;
+  tr->origin    = stats_now() * 1e6;
+
+  fprintf(out, "{\"traceEvents\": [\n");
+
+  return tr;
+}
+
+void trace_free(Trace *tr)
+{
+  fprintf(tr->out, "\n], \"displayTimeUnit\": \"ms\", "
+                   "\"otherData\": {\"min_depth\": %d, \"sample\": %d, "
+                   "\"events\": %ld}}\n",
+          tr->min_depth, tr->sample, tr->events);
+  fclose(tr->out);
+  free(tr);
+}
+
+double trace_enter(Trace *tr, int d)
+{
+  if ( d < tr->min_depth || tr->calls[stats_slot(d)]++ % tr->sample )
+    return -1;
+
+  return stats_now() * 1e6;
+}
+
+void trace_exit(Trace *tr, double start, int d, int t, int hit)
+{
+  const double end = stats_now() * 1e6;
+
+  // Calls complete in order of their ends, children before parents
+  fprintf(tr->out, "%s{\"name\": \"d%d t%d\", \"cat\": \"%s\", \"ph\": \"X\", "
+                   "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1, "
+                   "\"args\": {\"depth\": %d, \"t\": %d, \"hit\": %d}}",
+          tr->events ? ",\n" : "", d, t, hit ? "hit" : "miss",
+          start - tr->origin, end - start, d, t, hit);
+
+  tr->events++;
+}
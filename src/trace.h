@@ -0,0 +1,24 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+/* Trace of the fate() recursion, in the Chrome trace event format
+ * (chrome://tracing, ui.perfetto.dev).
+ *
+ * Every fate() call on a node of depth at least min_depth is an event,
+ * with its duration, depth, t and whether its result was memoized.
+ * Only one call out of sample is recorded at each depth; the calls which
+ * are not recorded cost one comparison and one increment. */
+
+typedef struct Trace Trace;
+
+// out is closed by trace_free()
+Trace *trace_new(FILE *out, int min_depth, int sample);
+void   trace_free(Trace *tr);
+
+// Start time of a call to be recorded, negative if it is not
+double trace_enter(Trace *tr, int d);
+void   trace_exit(Trace *tr, double start, int d, int t, int hit);
+
+#endif